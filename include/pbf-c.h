@@ -14,9 +14,15 @@
 extern "C" {
 #endif
 
+// The WithSeed variants hash keys under a 64-bit seed; seed 0 matches the
+// plain calls and the other bindings.
 #define PAGE_BLOOM_FILTER_FUNC(way) \
 extern bool PBF##way##_Set(void* space, unsigned page_level, unsigned page_num, const void* key, unsigned len); \
-extern bool PBF##way##_Test(const void* space, unsigned page_level, unsigned page_num, const void* key, unsigned len);
+extern bool PBF##way##_Test(const void* space, unsigned page_level, unsigned page_num, const void* key, unsigned len); \
+extern bool PBF##way##_SetWithSeed(void* space, unsigned page_level, unsigned page_num, \
+	const void* key, unsigned len, uint64_t seed); \
+extern bool PBF##way##_TestWithSeed(const void* space, unsigned page_level, unsigned page_num, \
+	const void* key, unsigned len, uint64_t seed);
 
 PAGE_BLOOM_FILTER_FUNC(4)
 PAGE_BLOOM_FILTER_FUNC(5)
@@ -26,6 +32,85 @@ PAGE_BLOOM_FILTER_FUNC(8)
 
 #undef PAGE_BLOOM_FILTER_FUNC
 
+// Batch forms of the calls above with seed 0, for callers that stage keys in
+// one buffer (e.g. WASM linear memory): fixed-width keys back to back, or keys
+// at buf[offsets[i], offsets[i+1]). Bitmaps are laid out as for the handle API
+// below; Set returns how many keys were new and takes a NULL bitmap.
+#define PAGE_BLOOM_FILTER_BATCH_FUNC(way) \
+extern size_t PBF##way##_SetStrided(void* space, unsigned page_level, unsigned page_num, \
+	const void* keys, unsigned len, size_t n, uint8_t* bitmap); \
+extern void PBF##way##_TestStrided(const void* space, unsigned page_level, unsigned page_num, \
+	const void* keys, unsigned len, size_t n, uint8_t* bitmap); \
+extern size_t PBF##way##_SetOffsets(void* space, unsigned page_level, unsigned page_num, \
+	const void* buf, const size_t* offsets, size_t n, uint8_t* bitmap); \
+extern void PBF##way##_TestOffsets(const void* space, unsigned page_level, unsigned page_num, \
+	const void* buf, const size_t* offsets, size_t n, uint8_t* bitmap);
+
+PAGE_BLOOM_FILTER_BATCH_FUNC(4)
+PAGE_BLOOM_FILTER_BATCH_FUNC(5)
+PAGE_BLOOM_FILTER_BATCH_FUNC(6)
+PAGE_BLOOM_FILTER_BATCH_FUNC(7)
+PAGE_BLOOM_FILTER_BATCH_FUNC(8)
+
+#undef PAGE_BLOOM_FILTER_BATCH_FUNC
+
+// Fold a bitmap of page_num pages in place down to page_num/factor pages,
+// which then hold the filter the same keys would build at that size. The
+// first page_num/factor pages of `space` are the result. False, with `space`
+// untouched, if `factor` is 0 or does not divide page_num.
+extern bool PBF_Fold(void* space, unsigned page_level, unsigned page_num, unsigned factor);
+
+// Handle API. A handle keeps the geometry, seed and a precomputed page divisor,
+// and its batch calls cross the language boundary once per batch. Keys follow
+// the rules of the calls above: NULL with len 0 is the empty key, NULL with a
+// non-zero len is rejected. Result bitmaps hold one bit per key, LSB first in
+// byte i/8, and cover (n+7)/8 bytes; unused high bits of the last byte are 0.
+// Every call accepts a NULL handle: accessors return 0 or NULL, pbf_clear and
+// pbf_free do nothing, pbf_fold and the set/test calls report no keys, and
+// bitmaps are left unwritten.
+// Not built into the freestanding all-in-one objects (C_ALL_IN_ONE).
+typedef struct pbf_filter pbf_filter;
+
+// NULL if the geometry is invalid or allocation fails. pbf_create starts empty
+// and pbf_restore copies page_num << page_level bytes from `data`.
+extern pbf_filter* pbf_create(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed);
+extern pbf_filter* pbf_restore(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed,
+	const void* data, size_t unique_cnt);
+// Borrows `space`, which must outlive the handle; pbf_free leaves it alone.
+extern pbf_filter* pbf_wrap(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed,
+	void* space, size_t unique_cnt);
+extern void pbf_free(pbf_filter* bf);
+
+extern unsigned pbf_way(const pbf_filter* bf);
+extern unsigned pbf_page_level(const pbf_filter* bf);
+extern unsigned pbf_page_num(const pbf_filter* bf);
+extern uint64_t pbf_seed(const pbf_filter* bf);
+extern size_t pbf_unique_cnt(const pbf_filter* bf);
+extern const void* pbf_data(const pbf_filter* bf);
+extern size_t pbf_data_size(const pbf_filter* bf);
+extern void pbf_clear(pbf_filter* bf);
+// PBF_Fold on the handle's bitmap. Owned bitmaps shrink to the new size;
+// pbf_data may move.
+extern bool pbf_fold(pbf_filter* bf, unsigned factor);
+
+extern bool pbf_set(pbf_filter* bf, const void* key, unsigned len);
+extern bool pbf_test(const pbf_filter* bf, const void* key, unsigned len);
+
+// Keys as arrays of pointers and lengths. The set calls return how many keys
+// were new and, when `bitmap` is not NULL, mark which ones.
+extern size_t pbf_set_batch(pbf_filter* bf, const void* const* keys, const unsigned* lens, size_t n,
+	uint8_t* bitmap);
+extern void pbf_test_batch(const pbf_filter* bf, const void* const* keys, const unsigned* lens, size_t n,
+	uint8_t* bitmap);
+// Keys of one length packed back to back.
+extern size_t pbf_set_strided(pbf_filter* bf, const void* keys, unsigned len, size_t n, uint8_t* bitmap);
+extern void pbf_test_strided(const pbf_filter* bf, const void* keys, unsigned len, size_t n, uint8_t* bitmap);
+// Key i is buf[offsets[i], offsets[i+1]), so `offsets` has n+1 entries.
+extern size_t pbf_set_offsets(pbf_filter* bf, const void* buf, const size_t* offsets, size_t n,
+	uint8_t* bitmap);
+extern void pbf_test_offsets(const pbf_filter* bf, const void* buf, const size_t* offsets, size_t n,
+	uint8_t* bitmap);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,66 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+#ifndef PAGE_BLOOM_FILTER_DISK_H
+#define PAGE_BLOOM_FILTER_DISK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <functional>
+#include "pbf.h"
+
+namespace pbf {
+
+// Query-only filter whose bitmap stays in a file. Each probe touches exactly
+// one page, so only the geometry is kept in memory and pages are read on
+// demand. Probes are queued, grouped by page and read in batches; completion
+// callbacks run on I/O threads.
+struct DiskBloomFilter {
+	struct Options {
+		size_t batch_size = 256;	// queued probes that trigger an automatic submit
+		unsigned queue_depth = 64;	// max in-flight page reads
+		unsigned io_threads = 4;	// pread workers when io_uring is unavailable
+		size_t cache_pages = 0;		// LRU cache of hot pages, 0 disables it
+		bool use_io_uring = true;	// fall back to pread workers if false or unsupported
+		HashId hash = DefaultHash();	// the hash and seed the bitmap was built with
+		uint64_t seed = 0;
+	};
+	using Callback = std::function<void(bool)>;
+
+	virtual ~DiskBloomFilter() = default;
+	virtual unsigned way() const noexcept = 0;
+	virtual unsigned page_level() const noexcept = 0;
+	virtual unsigned page_num() const noexcept = 0;
+	virtual HashId hash_id() const noexcept = 0;
+	virtual uint64_t seed() const noexcept = 0;
+	size_t data_size() const noexcept {
+		return static_cast<size_t>(page_num()) << page_level();
+	}
+	// "io_uring" or "pread".
+	virtual const char* backend() const noexcept = 0;
+	// Reads that failed; affected probes report true to avoid false negatives.
+	virtual size_t io_errors() const noexcept = 0;
+
+	// Queue a probe. The key is hashed before returning, so its buffer may be
+	// reused at once. `done` is invoked exactly once, possibly on another thread.
+	virtual void test(const uint8_t* data, unsigned len, Callback done) = 0;
+	// Submit queued probes without waiting for them.
+	virtual void flush() = 0;
+	// Submit queued probes and block until every outstanding probe completes.
+	virtual void wait() = 0;
+	// Synchronous probe.
+	bool test(const uint8_t* data, unsigned len);
+};
+
+// Open a bitmap persisted as `page_num << page_level` bytes starting at
+// `offset` in `path`. Returns nullptr on invalid geometry, a short file or an
+// unavailable hash.
+extern std::unique_ptr<DiskBloomFilter> OpenDiskBloomFilter(
+		const char* path, unsigned way, unsigned page_level, unsigned page_num,
+		uint64_t offset=0, const DiskBloomFilter::Options& options=DiskBloomFilter::Options());
+
+} //pbf
+#endif //PAGE_BLOOM_FILTER_DISK_H
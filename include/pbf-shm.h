@@ -0,0 +1,69 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+#ifndef PAGE_BLOOM_FILTER_SHM_H
+#define PAGE_BLOOM_FILTER_SHM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include "pbf.h"
+
+namespace pbf {
+
+// Filter kept in a shared memory segment, so every process of a prefork pool
+// works on one bitmap. The segment starts with a 64-byte header holding the
+// geometry, hash, seed and unique count, followed by the bitmap in the usual
+// layout. set() ORs bits in with atomic word updates and bumps the shared
+// counter, so writers in any process never lose each other's bits. test() is
+// lock-free. Bits only go from 0 to 1 between clears, so a probe racing a set
+// of the same key may miss it but never sees a torn state.
+struct SharedBloomFilter {
+	virtual ~SharedBloomFilter() = default;
+	virtual unsigned way() const noexcept = 0;
+	virtual unsigned page_level() const noexcept = 0;
+	virtual unsigned page_num() const noexcept = 0;
+	virtual HashId hash_id() const noexcept = 0;
+	virtual uint64_t seed() const noexcept = 0;
+	size_t data_size() const noexcept {
+		return static_cast<size_t>(page_num()) << page_level();
+	}
+	// Shared by all attached processes. Two processes inserting the same key
+	// at the same moment may both count it.
+	virtual size_t unique_cnt() const noexcept = 0;
+	virtual const uint8_t* data() const noexcept = 0;
+	// Descriptor of the segment. It stays valid after fork and can be passed
+	// to unrelated processes over a unix socket.
+	virtual int fd() const noexcept = 0;
+	virtual bool writable() const noexcept = 0;
+
+	virtual bool test(const uint8_t* data, unsigned len) const noexcept = 0;
+	// Always false on a read-only attachment.
+	virtual bool set(const uint8_t* data, unsigned len) noexcept = 0;
+	// Not atomic with respect to concurrent set() calls.
+	virtual void clear() noexcept = 0;
+};
+
+// Create and map a new segment. `name` follows shm_open rules ("/name") and
+// creation fails if it already exists. With a null name the segment is
+// anonymous (memfd on Linux) and is shared through fork or fd(). Returns
+// nullptr on invalid geometry, an unavailable hash or a system error.
+extern std::unique_ptr<SharedBloomFilter> CreateSharedBloomFilter(
+		const char* name, unsigned way, unsigned page_level, unsigned page_num,
+		HashId hash=DefaultHash(), uint64_t seed=0);
+extern std::unique_ptr<SharedBloomFilter> CreateSharedBloomFilter(
+		const char* name, const Plan& plan, HashId hash=DefaultHash(), uint64_t seed=0);
+
+// Map an existing segment by name, or by descriptor (which is duplicated, the
+// caller keeps its own). Returns nullptr if the segment is missing, too short,
+// not fully initialized or uses a hash this build cannot run.
+extern std::unique_ptr<SharedBloomFilter> AttachSharedBloomFilter(const char* name, bool writable=true);
+extern std::unique_ptr<SharedBloomFilter> AttachSharedBloomFilter(int fd, bool writable=true);
+
+// Remove a named segment. Processes that have it mapped keep using it.
+extern bool RemoveSharedBloomFilter(const char* name) noexcept;
+
+} //pbf
+#endif //PAGE_BLOOM_FILTER_SHM_H
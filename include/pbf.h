@@ -11,6 +11,7 @@
 #include <cstddef>
 #include <cassert>
 #include <memory>
+#include <vector>
 #include <algorithm>
 #include <type_traits>
 
@@ -68,7 +69,12 @@ private:
 public:
 	Word value() const noexcept { return m_val; }
 	Divisor() noexcept = default;
-	explicit Divisor(Word n) noexcept { *this = n; }
+	constexpr explicit Divisor(Word n) noexcept
+		: m_val(n)
+#ifndef DISABLE_SOFT_DIVIDE
+		, m_fac(n == 0 ? 0 : static_cast<DoubleWord>(static_cast<DoubleWord>(~DoubleWord(0)) / n + 1))
+#endif
+	{}
 
 	Divisor& operator=(Word n) noexcept {
 		m_val = n;
@@ -119,11 +125,167 @@ static inline Word operator%(Word m, const Divisor<Word>& d) noexcept {
 
 static constexpr unsigned kMaxPageNum = 1u << 18;
 
+// Key hash of a filter. A bitmap is only meaningful under the hash and seed it
+// was built with, so both must be stored and restored along with the data.
+// Each hash takes a 64-bit seed; distinct seeds give independent hash families
+// and seed 0 is the standard layout.
+enum class HashId : uint8_t {
+	kSpooky = 0,	// shared with the Go, Rust, Python and TypeScript bindings
+	kXXH3 = 1,		// available when xxh3.h is found at build time
+	kAESNI = 2,		// x86-64 with AES-NI
+	kCRC32C = 3,	// CRC32C instruction on x86-64 and AArch64, table-driven elsewhere
+};
+
+// kSpooky unless the library was built with another default hash.
+extern HashId DefaultHash() noexcept;
+// Whether this build and CPU can run the hash.
+extern bool HashAvailable(HashId id) noexcept;
+extern const char* HashName(HashId id) noexcept;
+
+namespace detail {
+
+struct Hash128 {
+	uint64_t l;
+	uint64_t h;
+};
+
+using HashFunc = Hash128 (*)(const uint8_t* msg, unsigned len, uint64_t seed);
+
+} // detail
+
+// Health snapshot of a filter, see PageBloomFilter::stats.
+struct FilterStats {
+	static constexpr unsigned kHistogramBins = 16;
+	size_t pages = 0;				// pages scanned
+	double fill_ratio = 0;			// set bits / scanned bits
+	double min_page_fill = 0;
+	double max_page_fill = 0;
+	// Scanned pages by fill ratio, bin i covers [i/16, (i+1)/16).
+	size_t histogram[kHistogramBins] = {};
+	double estimated_fpr = 0;		// mean of page_fill^way over pages
+	size_t estimated_items = 0;		// distinct items implied by page fills
+	// Items left before estimated_fpr reaches the target. Projected from the
+	// measured page fills, assuming the new items spread evenly over pages.
+	size_t capacity_remaining = 0;
+};
+
+// Operation counters of PageBloomFilter and BloomFilter, summed over all
+// filters and threads of the process. Each thread counts into its own block,
+// so the probes share no cache lines. Collected only when the library is built
+// with PBF_ENABLE_STATS; otherwise the filters carry no extra code and the
+// snapshot is all zero. FixedPageBloomFilter and FilterSet are not counted.
+struct OpStats {
+	static constexpr unsigned kBins = 32;
+	uint64_t tests = 0;				// keys probed, single and batch
+	uint64_t positives = 0;			// probes that returned true
+	uint64_t sets = 0;				// keys inserted, single and batch
+	uint64_t new_inserts = 0;		// inserts that set at least one new bit
+	uint64_t batches = 0;			// test_batch and set_batch calls
+	// Batch calls by key count, bin i covers [2^i, 2^(i+1)).
+	uint64_t batch_sizes[kBins] = {};
+	// Every sample_period-th call of a thread is timed. Bin i covers
+	// [2^i, 2^(i+1)) ticks, and ticks_per_ns converts them to time.
+	uint64_t sample_period = 0;
+	double ticks_per_ns = 0;
+	uint64_t test_latency[kBins] = {};
+	uint64_t set_latency[kBins] = {};
+	uint64_t batch_latency[kBins] = {};	// whole calls
+};
+
+extern bool OpStatsEnabled() noexcept;
+// Counters are monotonic; export differences between snapshots as rates.
+extern OpStats SnapshotOpStats();
+
+// Source of bitmap storage, modeled on std::pmr::memory_resource (C++17) so
+// filters can come from arenas, pools or huge-page slabs. allocate returns
+// nullptr on failure. A resource must outlive every filter it backs.
+struct MemoryResource {
+	virtual ~MemoryResource() = default;
+	virtual void* allocate(size_t size, size_t align) noexcept = 0;
+	virtual void deallocate(void* p, size_t size, size_t align) noexcept = 0;
+	// True if allocate() always returns zero-filled memory, so empty filters
+	// skip their memset.
+	virtual bool zeroed() const noexcept { return false; }
+	// Zero [p, p+size) within an allocated block more cheaply than memset, or
+	// return false to leave it to the caller. Used by clear().
+	virtual bool discard(void* p, size_t size) noexcept {
+		(void)p;
+		(void)size;
+		return false;
+	}
+};
+
+// Global operator new and delete, used whenever a filter gets no resource.
+extern MemoryResource* DefaultMemoryResource() noexcept;
+
+// Recycles blocks of one size, carved from slabs of `blocks_per_slab` blocks
+// taken from `upstream`. It suits many short-lived filters of one geometry.
+// Requests larger than block_size() go straight to upstream. It is not
+// thread-safe, and slabs return upstream only when the pool is destroyed.
+class PoolMemoryResource final : public MemoryResource {
+public:
+	explicit PoolMemoryResource(size_t block_size, size_t blocks_per_slab=64, MemoryResource* upstream=nullptr);
+	~PoolMemoryResource() override;
+	PoolMemoryResource(const PoolMemoryResource&) = delete;
+	PoolMemoryResource& operator=(const PoolMemoryResource&) = delete;
+
+	size_t block_size() const noexcept { return m_block_size; }
+	void* allocate(size_t size, size_t align) noexcept override;
+	void deallocate(void* p, size_t size, size_t align) noexcept override;
+
+private:
+	MemoryResource* m_upstream;
+	size_t m_block_size;
+	size_t m_blocks_per_slab;
+	void* m_free = nullptr;		// singly linked through the blocks
+	std::vector<void*> m_slabs;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// Private anonymous mappings with MAP_NORESERVE. The kernel supplies zero
+// pages on first touch, so a new filter costs no time and no resident memory
+// until keys land in its pages. discard() hands whole pages of ranges of at
+// least `discard_threshold` bytes back with madvise(MADV_DONTNEED), so
+// clear() on a huge filter no longer scales with its size and drops its
+// resident memory. Smaller ranges are cleared with memset. Thread-safe.
+class MappedMemoryResource final : public MemoryResource {
+public:
+	explicit MappedMemoryResource(size_t discard_threshold=size_t{1}<<20) noexcept;
+
+	size_t discard_threshold() const noexcept { return m_discard_threshold; }
+	void* allocate(size_t size, size_t align) noexcept override;
+	void deallocate(void* p, size_t size, size_t align) noexcept override;
+	bool zeroed() const noexcept override { return true; }
+	bool discard(void* p, size_t size) noexcept override;
+
+private:
+	size_t m_page_size;
+	size_t m_discard_threshold;
+};
+#endif
+
+namespace detail {
+
+// Bitmaps are cache line aligned, so no page straddles two lines.
+constexpr size_t kSpaceAlign = 64;
+
+struct SpaceDeleter {
+	MemoryResource* resource = nullptr;
+	size_t size = 0;
+	void operator()(uint8_t* p) const noexcept {
+		resource->deallocate(p, size, kSpaceAlign);
+	}
+};
+
+} // detail
+
 class _PageBloomFilter {
 public:
 	bool operator!() const noexcept { return m_space == nullptr; }
 	unsigned page_level() const noexcept { return m_page_level; }
 	unsigned page_num() const noexcept { return m_page_num.value(); }
+	HashId hash_id() const noexcept { return m_hash_id; }
+	uint64_t seed() const noexcept { return m_seed; }
 	size_t unique_cnt() const noexcept { return m_unique_cnt; }
 	const uint8_t* data() const noexcept { return m_space.get(); }
 	size_t data_size() const noexcept {
@@ -131,27 +293,86 @@ public:
 	}
 	void clear() noexcept;
 
+	// Whether fold(factor) is legal: `factor` divides page_num().
+	bool foldable(unsigned factor) const noexcept {
+		return m_space != nullptr && factor != 0 && m_page_num.value() % factor == 0;
+	}
+	// Shrink to page_num()/factor pages by ORing page i+k*page_num()/factor
+	// into page i. The result is the filter those keys would have built at the
+	// smaller size, with the same hash and seed, so filters sized differently
+	// can be folded to a common size and their bitmaps ORed together. The new
+	// bitmap is a fresh allocation from the same resource and data() changes;
+	// unique_cnt is kept. A FilterSet holding this filter would keep probing
+	// the freed bitmap: clear the set before folding and add the filter again
+	// afterwards. Returns false and leaves the filter untouched if `factor` is
+	// not legal or the allocation fails.
+	bool fold(unsigned factor);
+
 protected:
 	unsigned m_page_level = 0;
 	Divisor<uint32_t> m_page_num;
 	size_t m_unique_cnt = 0;
-	std::unique_ptr<uint8_t[]> m_space;
+	std::unique_ptr<uint8_t[], detail::SpaceDeleter> m_space;
+	HashId m_hash_id = HashId::kSpooky;
+	detail::HashFunc m_hash = nullptr;	// resolved once from m_hash_id
+	uint64_t m_seed = 0;
+
+	void init(unsigned page_level, unsigned page_num, size_t unique_cnt, const uint8_t* data,
+			  HashId hash, uint64_t seed, MemoryResource* resource);
 
-	void init(unsigned page_level, unsigned page_num, size_t unique_cnt, const uint8_t* data);
+	friend class FilterSet;
 };
 
+// Where the planner should try to keep the whole bitmap.
+enum class CacheTier : unsigned {
+	kDRAM,	// no residency constraint
+	kLLC,
+	kL2,
+};
+
+struct PlanRequest {
+	size_t item = 0;				// expected distinct items, required
+	size_t memory_budget = 0;		// bytes, 0 for unlimited
+	float fpr = 0;					// target FPR, 0 to minimize FPR within the budget
+	CacheTier tier = CacheTier::kDRAM;
+	size_t l2_size = size_t{1} << 20;
+	size_t llc_size = size_t{32} << 20;
+};
+
+struct Plan {
+	unsigned way = 0;
+	unsigned page_level = 0;
+	unsigned page_num = 0;
+	double fpr = 0;				// predicted at `item`, accounting for uneven page load
+	double probe_cost = 0;		// rough test() latency in ns for the expected residency
+	bool operator!() const noexcept { return way == 0; }
+	size_t data_size() const noexcept { return static_cast<size_t>(page_num) << page_level; }
+};
+
+// Choose (way, page_level, page_num). With a target FPR, the smallest bitmap
+// meeting it wins, preferring cheaper probes among near-equal sizes. Without
+// one, the lowest FPR within the budget wins. When the target cannot be met
+// within the budget and tier, the lowest-FPR plan that fits is returned, so
+// compare `fpr` with the target. Returns an empty plan if nothing fits.
+extern Plan PlanFilter(const PlanRequest& req);
+
 template <unsigned N>
 class PageBloomFilter final : public _PageBloomFilter {
 public:
 	static_assert(N >= 4 && N <= 8, "N should be 4-8");
 
-	// page_level should be (8-8/N) ~ 13
-	PageBloomFilter(unsigned page_level, unsigned page_num, size_t unique_cnt=0, const uint8_t* data=nullptr) {
+	// page_level should be (8-8/N) ~ 13. The filter stays empty if `hash` is
+	// unavailable or `resource` (nullptr for the default) cannot supply the bitmap.
+	PageBloomFilter(unsigned page_level, unsigned page_num, size_t unique_cnt=0, const uint8_t* data=nullptr,
+					HashId hash=DefaultHash(), uint64_t seed=0, MemoryResource* resource=nullptr) {
 		if (page_level < (8-8/N) || page_level > 13 || page_num == 0 || page_num >= kMaxPageNum) {
 			return;
 		}
-		init(page_level, page_num, unique_cnt, data);
+		init(page_level, page_num, unique_cnt, data, hash, seed, resource);
 	}
+	explicit PageBloomFilter(const Plan& plan, HashId hash=DefaultHash(), uint64_t seed=0,
+							 MemoryResource* resource=nullptr)
+		: PageBloomFilter(plan.way == N ? plan.page_level : 0, plan.page_num, 0, nullptr, hash, seed, resource) {}
 
 	// unique_cnt/capacity should be 50%-80%
 	size_t capacity() const noexcept {
@@ -164,15 +385,110 @@ public:
 	}
 	unsigned way() const noexcept { return N; }
 
+	// Scan page popcounts. `sample_step` > 1 scans every n-th page only and
+	// scales counts up, for cheap checks on very large filters.
+	FilterStats stats(float fpr, unsigned sample_step=1) const noexcept;
+
 	bool test(const uint8_t* data, unsigned len) const noexcept;
 	bool set(const uint8_t* data, unsigned len) noexcept;
+
+	// Batch variants hash a window of keys and prefetch their pages before
+	// probing, overlapping memory latency across keys. `set_batch` returns
+	// the number of new keys.
+	void test_batch(const uint8_t* const* keys, const unsigned* lens, size_t n, bool* out) const noexcept;
+	size_t set_batch(const uint8_t* const* keys, const unsigned* lens, size_t n) noexcept;
+	// Fixed-width keys packed back to back.
+	void test_batch(const uint8_t* keys, unsigned len, size_t n, bool* out) const noexcept;
+	size_t set_batch(const uint8_t* keys, unsigned len, size_t n) noexcept;
 };
 
+#ifndef PBF_HEADER_ONLY
 extern template class PageBloomFilter<4>;
 extern template class PageBloomFilter<5>;
 extern template class PageBloomFilter<6>;
 extern template class PageBloomFilter<7>;
 extern template class PageBloomFilter<8>;
+#endif
+
+namespace detail {
+
+struct FixedKey {
+	Hash128 code;
+	uint32_t page_hash;		// reduced modulo the page count by the caller
+};
+
+// Stages of a FixedPageBloomFilter probe, instantiated in the library for
+// every legal (way, page_level): hash the key (false for keys the API
+// rejects), then test or set bits in the chosen page. The page is picked in
+// the header, where the page count is a constant.
+template <unsigned N, unsigned PageLevel>
+struct FixedProbe {
+	static bool hash(const uint8_t* data, unsigned len, uint64_t seed, FixedKey& key) noexcept;
+	static bool test(const uint8_t* page, const FixedKey& key) noexcept;
+	static bool set(uint8_t* page, const FixedKey& key) noexcept;
+};
+
+} // detail
+
+// Filter with geometry fixed at build time, for static data such as embedded
+// blocklists. The bitmap lives inside the object and a default constructed
+// instance is constant-initialized, so it can sit in static storage. Keep it
+// there (or on a stack large enough): the bitmap is 64-byte aligned, which
+// plain new does not honour before C++17. The layout matches
+// PageBloomFilter<N> with the same geometry, DefaultHash() and seed, so
+// bitmaps move freely between the two.
+template <unsigned N, unsigned PageLevel, unsigned PageNum>
+class FixedPageBloomFilter final {
+public:
+	static_assert(N >= 4 && N <= 8, "N should be 4-8");
+	static_assert(PageLevel >= (8-8/N) && PageLevel <= 13, "PageLevel should be (8-8/N) ~ 13");
+	static_assert(PageNum != 0 && PageNum < kMaxPageNum, "PageNum out of range");
+
+	constexpr FixedPageBloomFilter() noexcept = default;
+	constexpr explicit FixedPageBloomFilter(uint64_t seed) noexcept : m_seed(seed) {}
+	// Restore from a bitmap of data_size() bytes.
+	FixedPageBloomFilter(const uint8_t* data, size_t unique_cnt, uint64_t seed=0) noexcept
+		: m_unique_cnt(unique_cnt), m_seed(seed) {
+		std::copy(data, data + data_size(), m_space);
+	}
+
+	static constexpr unsigned way() noexcept { return N; }
+	static constexpr unsigned page_level() noexcept { return PageLevel; }
+	static constexpr unsigned page_num() noexcept { return PageNum; }
+	static constexpr size_t data_size() noexcept { return static_cast<size_t>(PageNum) << PageLevel; }
+	static constexpr size_t capacity() noexcept { return data_size() * 8 / N; }
+	size_t unique_cnt() const noexcept { return m_unique_cnt; }
+	uint64_t seed() const noexcept { return m_seed; }
+	const uint8_t* data() const noexcept { return m_space; }
+	void clear() noexcept {
+		m_unique_cnt = 0;
+		std::fill(m_space, m_space + data_size(), 0);
+	}
+
+	bool test(const uint8_t* data, unsigned len) const noexcept {
+		detail::FixedKey key;
+		return Probe::hash(data, len, m_seed, key) && Probe::test(m_space + offset(key.page_hash), key);
+	}
+	bool set(const uint8_t* data, unsigned len) noexcept {
+		detail::FixedKey key;
+		if (Probe::hash(data, len, m_seed, key) && Probe::set(m_space + offset(key.page_hash), key)) {
+			m_unique_cnt++;
+			return true;
+		}
+		return false;
+	}
+
+private:
+	using Probe = detail::FixedProbe<N, PageLevel>;
+	// Both forms fold at compile time; a power-of-two page count is a mask.
+	static constexpr size_t offset(uint32_t page_hash) noexcept {
+		return static_cast<size_t>((PageNum & (PageNum - 1)) == 0 ? page_hash & (PageNum - 1)
+																	: page_hash % PageNum) << PageLevel;
+	}
+	size_t m_unique_cnt = 0;
+	uint64_t m_seed = 0;
+	alignas(64) uint8_t m_space[static_cast<size_t>(PageNum) << PageLevel] = {};
+};
 
 static constexpr unsigned BestWay(float fpr) noexcept {
 	fpr = std::min(std::max(fpr, 0.0005f), 0.1f);
@@ -189,7 +505,8 @@ static constexpr unsigned BestWay(float fpr) noexcept {
 }
 
 template <unsigned N>
-static PageBloomFilter<N> Create(size_t item, float fpr) {
+static PageBloomFilter<N> Create(size_t item, float fpr, HashId hash=DefaultHash(), uint64_t seed=0,
+								 MemoryResource* resource=nullptr) {
 	assert(N == BestWay(fpr));
 	item = std::max<size_t>(item, 1);
 	fpr = std::min(std::max(fpr, 0.0005f), 0.1f);
@@ -220,7 +537,7 @@ static PageBloomFilter<N> Create(size_t item, float fpr) {
 	if (page_num >= kMaxPageNum) {
 		page_num = 0;
 	}
-	return PageBloomFilter<N>(page_level, page_num);
+	return PageBloomFilter<N>(page_level, page_num, 0, nullptr, hash, seed, resource);
 }
 
 struct BloomFilter : public _PageBloomFilter {
@@ -228,22 +545,74 @@ struct BloomFilter : public _PageBloomFilter {
 	virtual size_t capacity() const noexcept = 0;
 	virtual size_t virtual_capacity(float fpr) const noexcept = 0;
 	virtual unsigned way() const noexcept = 0;
+	virtual FilterStats stats(float fpr, unsigned sample_step=1) const noexcept = 0;
 	virtual bool test(const uint8_t* data, unsigned len) const noexcept = 0;
 	virtual bool set(const uint8_t* data, unsigned len) noexcept = 0;
+	virtual void test_batch(const uint8_t* const* keys, const unsigned* lens, size_t n, bool* out) const noexcept = 0;
+	virtual size_t set_batch(const uint8_t* const* keys, const unsigned* lens, size_t n) noexcept = 0;
+	virtual void test_batch(const uint8_t* keys, unsigned len, size_t n, bool* out) const noexcept = 0;
+	virtual size_t set_batch(const uint8_t* keys, unsigned len, size_t n) noexcept = 0;
+
+	// Call f with this filter as its concrete PageBloomFilter<way()>&,
+	// dispatching on the way once. A generic lambda is then compiled per way
+	// and its loop calls test/set directly, not through the vtable. Every
+	// instantiation of f must return the same type.
+	template <typename Visitor>
+	decltype(auto) visit(Visitor&& f) {
+		switch (way()) {
+			case 4: return f(as<4>());
+			case 5: return f(as<5>());
+			case 6: return f(as<6>());
+			case 7: return f(as<7>());
+			default: return f(as<8>());
+		}
+	}
+	template <typename Visitor>
+	decltype(auto) visit(Visitor&& f) const {
+		switch (way()) {
+			case 4: return f(as<4>());
+			case 5: return f(as<5>());
+			case 6: return f(as<6>());
+			case 7: return f(as<7>());
+			default: return f(as<8>());
+		}
+	}
+
+private:
+	// The implementation keeps a PageBloomFilter<N> in the base subobject, see
+	// BloomFilterImp in pbf.cc.
+	template <unsigned N>
+	PageBloomFilter<N>& as() noexcept {
+		return *reinterpret_cast<PageBloomFilter<N>*>(static_cast<_PageBloomFilter*>(this));
+	}
+	template <unsigned N>
+	const PageBloomFilter<N>& as() const noexcept {
+		return *reinterpret_cast<const PageBloomFilter<N>*>(static_cast<const _PageBloomFilter*>(this));
+	}
 };
 
-extern std::unique_ptr<BloomFilter> New(size_t item, float fpr);
+// `resource` backs the bitmap only; the BloomFilter object itself comes from new.
+extern std::unique_ptr<BloomFilter> New(size_t item, float fpr, HashId hash=DefaultHash(), uint64_t seed=0,
+										MemoryResource* resource=nullptr);
 // Restore a BloomFilter from raw bitmap data.
 // `page_num` must match the supplied bitmap length and `unique_cnt` is trusted
 // as caller-provided metadata rather than recomputed from the bitmap.
+// `hash` and `seed` must be the ones the bitmap was built with.
 extern std::unique_ptr<BloomFilter> New(unsigned way, unsigned page_level, unsigned page_num,
-										size_t unique_cnt=0, const uint8_t* data=nullptr);
+										size_t unique_cnt=0, const uint8_t* data=nullptr,
+										HashId hash=DefaultHash(), uint64_t seed=0,
+										MemoryResource* resource=nullptr);
+
+extern std::unique_ptr<BloomFilter> New(const Plan& plan, HashId hash=DefaultHash(), uint64_t seed=0,
+										MemoryResource* resource=nullptr);
 
 // Convenience overload for restoring from a contiguous bitmap buffer.
 // `data_size` must be an exact multiple of `(1 << page_level)` bytes; otherwise
 // the computed page count would be truncated before dispatching to `New(...)`.
 static inline std::unique_ptr<BloomFilter> New(unsigned way, unsigned page_level,
-                                               const uint8_t* data, size_t data_size, size_t unique_cnt) {
+                                               const uint8_t* data, size_t data_size, size_t unique_cnt,
+                                               HashId hash=DefaultHash(), uint64_t seed=0,
+                                               MemoryResource* resource=nullptr) {
 	if (data == nullptr || data_size == 0 || page_level > 13) {
 		return nullptr;
 	}
@@ -255,11 +624,245 @@ static inline std::unique_ptr<BloomFilter> New(unsigned way, unsigned page_level
 	if (page_num >= kMaxPageNum) {
 		return nullptr;
 	}
-	return New(way, page_level, static_cast<unsigned>(page_num), unique_cnt, data);
+	return New(way, page_level, static_cast<unsigned>(page_num), unique_cnt, data, hash, seed, resource);
 }
 
+// Probes one key against up to 64 filters, e.g. one per run of an LSM tree.
+// The key is hashed once per distinct (hash, seed) pair among the members and
+// every candidate page is prefetched before any is evaluated, so the cache
+// misses overlap instead of queueing one after another. Members may differ in
+// way and geometry. They are referenced, not owned: keep them alive and in
+// place (no move or reassignment) while they belong to the set. add() copies
+// the bitmap address and page count, so a member must also leave the set
+// (clear() it) before fold() and be added again afterwards.
+class FilterSet final {
+public:
+	static constexpr unsigned kMaxFilters = 64;
+
+	// Returns false when the set is full or the filter is empty.
+	bool add(const BloomFilter& filter) { return attach(filter, filter.way()); }
+	template <unsigned N>
+	bool add(const PageBloomFilter<N>& filter) { return attach(filter, N); }
+	void clear() noexcept {
+		m_members.clear();
+		m_groups.clear();
+	}
+	unsigned size() const noexcept { return static_cast<unsigned>(m_members.size()); }
+
+	// Bit i is set when the i-th added filter may contain the key.
+	uint64_t test(const uint8_t* data, unsigned len) const noexcept;
+	// Whether any member may contain the key, evaluated in insertion order
+	// and stopping at the first hit.
+	bool test_any(const uint8_t* data, unsigned len) const noexcept;
+
+private:
+	struct Member {
+		const uint8_t* space;
+		Divisor<uint32_t> page_num;
+		uint8_t page_level;
+		uint8_t way;
+		uint8_t group;	// index into m_groups
+	};
+	struct Group {
+		detail::HashFunc hash;
+		uint64_t seed;
+	};
+	std::vector<Member> m_members;
+	std::vector<Group> m_groups;
+
+	bool attach(const _PageBloomFilter& filter, unsigned way);
+};
+
+// Many filters of one geometry, hash and seed in a single allocation, such as
+// one small filter per user. Metadata is shared, so each filter costs only its
+// bitmap. Filters are addressed by index, and filter `id` has the bitmap
+// PageBloomFilter<way()> would build from the same keys. Unique counts are not
+// tracked, and an out-of-range id tests and sets nothing.
+class BloomFilterArray final {
+public:
+	BloomFilterArray() noexcept = default;
+	// `count` empty filters. The array stays empty on invalid geometry, an
+	// unavailable hash or a failed allocation.
+	BloomFilterArray(size_t count, unsigned way, unsigned page_level, unsigned page_num,
+					 HashId hash=DefaultHash(), uint64_t seed=0, MemoryResource* resource=nullptr);
+	BloomFilterArray(size_t count, const Plan& plan, HashId hash=DefaultHash(), uint64_t seed=0,
+					 MemoryResource* resource=nullptr)
+		: BloomFilterArray(count, plan.way, plan.page_level, plan.page_num, hash, seed, resource) {}
+
+	bool operator!() const noexcept { return m_space == nullptr; }
+	size_t size() const noexcept { return m_count; }
+	unsigned way() const noexcept { return m_way; }
+	unsigned page_level() const noexcept { return m_page_level; }
+	unsigned page_num() const noexcept { return m_page_num.value(); }
+	HashId hash_id() const noexcept { return m_hash_id; }
+	uint64_t seed() const noexcept { return m_seed; }
+	// Bytes per filter; the array holds size() * filter_size() bytes.
+	size_t filter_size() const noexcept {
+		return static_cast<size_t>(m_page_num.value()) << m_page_level;
+	}
+	const uint8_t* data(size_t id) const noexcept {
+		return id < m_count ? m_space.get() + id * filter_size() : nullptr;
+	}
+
+	bool test(size_t id, const uint8_t* data, unsigned len) const noexcept;
+	bool set(size_t id, const uint8_t* data, unsigned len) noexcept;
+	// Key i goes to filter ids[i]. Keys are hashed a window at a time and
+	// their pages prefetched before probing. `set_batch` returns how many keys
+	// were new.
+	void test_batch(const size_t* ids, const uint8_t* const* keys, const unsigned* lens, size_t n,
+					bool* out) const noexcept;
+	size_t set_batch(const size_t* ids, const uint8_t* const* keys, const unsigned* lens, size_t n) noexcept;
+	// Fixed-width keys packed back to back.
+	void test_batch(const size_t* ids, const uint8_t* keys, unsigned len, size_t n, bool* out) const noexcept;
+	size_t set_batch(const size_t* ids, const uint8_t* keys, unsigned len, size_t n) noexcept;
+
+	void clear(size_t id) noexcept;
+	void clear() noexcept;
+	// Overwrite filter `id` with filter_size() bytes of a bitmap built with the
+	// same geometry, hash and seed.
+	bool load(size_t id, const uint8_t* data) noexcept;
+	// Standalone copy of filter `id`, with unique_cnt 0. nullptr if out of range.
+	std::unique_ptr<BloomFilter> extract(size_t id, MemoryResource* resource=nullptr) const;
+
+private:
+	size_t m_count = 0;
+	unsigned m_way = 0;
+	unsigned m_page_level = 0;
+	Divisor<uint32_t> m_page_num;
+	HashId m_hash_id = HashId::kSpooky;
+	detail::HashFunc m_hash = nullptr;
+	uint64_t m_seed = 0;
+	std::unique_ptr<uint8_t[], detail::SpaceDeleter> m_space;
+};
+
+// Paged filter where a key has two candidate pages, both taken from its hash,
+// and set() writes the one with fewer bits set (the power of two choices).
+// Page fill spreads less than under PageHash % page_num alone, at the cost of
+// a second page per test() and a 16-bit fill counter per page beside the
+// bitmap. The counters are allocated from the same MemoryResource. Bitmaps
+// do not interchange with PageBloomFilter's. pbf-fpr and the choice/* cases
+// of pbf-gbench compare the two layouts at equal bitmap size.
+template <unsigned N>
+class TwoChoiceBloomFilter final {
+public:
+	static_assert(N >= 4 && N <= 8, "N should be 4-8");
+
+	TwoChoiceBloomFilter() noexcept = default;
+	// page_level should be (8-8/N) ~ 13. Restoring from `data` recounts page
+	// fill. The filter stays empty on invalid geometry, an unavailable hash or
+	// a failed allocation.
+	TwoChoiceBloomFilter(unsigned page_level, unsigned page_num, size_t unique_cnt=0, const uint8_t* data=nullptr,
+						 HashId hash=DefaultHash(), uint64_t seed=0, MemoryResource* resource=nullptr);
+
+	bool operator!() const noexcept { return m_space == nullptr; }
+	unsigned way() const noexcept { return N; }
+	unsigned page_level() const noexcept { return m_page_level; }
+	unsigned page_num() const noexcept { return m_page_num.value(); }
+	HashId hash_id() const noexcept { return m_hash_id; }
+	uint64_t seed() const noexcept { return m_seed; }
+	size_t unique_cnt() const noexcept { return m_unique_cnt; }
+	const uint8_t* data() const noexcept { return m_space.get(); }
+	size_t data_size() const noexcept {
+		return static_cast<size_t>(m_page_num.value()) << m_page_level;
+	}
+	size_t capacity() const noexcept {
+		return data_size() * 8 / N;
+	}
+	// Set bits in page `i`, saturating at 65535.
+	unsigned page_fill(unsigned i) const noexcept {
+		return i < m_page_num.value() ? fill()[i] : 0;
+	}
+	void clear() noexcept;
+
+	// Both pages are prefetched before either is probed.
+	bool test(const uint8_t* data, unsigned len) const noexcept;
+	// A key already present in either page is not written again.
+	bool set(const uint8_t* data, unsigned len) noexcept;
+
+private:
+	uint16_t* fill() const noexcept { return reinterpret_cast<uint16_t*>(m_fill.get()); }
+
+	unsigned m_page_level = 0;
+	Divisor<uint32_t> m_page_num;
+	size_t m_unique_cnt = 0;
+	std::unique_ptr<uint8_t[], detail::SpaceDeleter> m_space;
+	std::unique_ptr<uint8_t[], detail::SpaceDeleter> m_fill;
+	HashId m_hash_id = HashId::kSpooky;
+	detail::HashFunc m_hash = nullptr;
+	uint64_t m_seed = 0;
+};
+
+extern template class TwoChoiceBloomFilter<4>;
+extern template class TwoChoiceBloomFilter<5>;
+extern template class TwoChoiceBloomFilter<6>;
+extern template class TwoChoiceBloomFilter<7>;
+extern template class TwoChoiceBloomFilter<8>;
+
+// Immutable binary fuse filter (Graf & Lemire), built once from a finished
+// key set. A key maps to three slots in adjacent segments and matches when
+// their fingerprints XOR to its own, so a probe touches at most three cache
+// lines. It takes about 1.13 slots per key: uint8_t fingerprints give ~0.39%
+// FPR at ~9 bits per key, uint16_t ~0.0015% at ~18, where a paged bloom
+// filter needs about 44% more bits for the same FPR. Keys are hashed with
+// HashId and seed like the other filters.
+template <typename Fingerprint>
+class BinaryFuseFilter final {
+public:
+	static_assert(std::is_same<Fingerprint, uint8_t>::value || std::is_same<Fingerprint, uint16_t>::value,
+				  "Fingerprint should be uint8_t or uint16_t");
+
+	BinaryFuseFilter() noexcept = default;
+	// Build from n keys, duplicates allowed. Keys are hashed on `threads`
+	// threads (0 for one per core), then peeled on the calling one. The filter
+	// stays empty on an invalid key, more than 2^31 keys, an unavailable hash,
+	// or if construction fails to converge.
+	BinaryFuseFilter(const uint8_t* const* keys, const unsigned* lens, size_t n, unsigned threads=1,
+					 HashId hash=DefaultHash(), uint64_t seed=0);
+	// Fixed-width keys packed back to back.
+	BinaryFuseFilter(const uint8_t* keys, unsigned len, size_t n, unsigned threads=1,
+					 HashId hash=DefaultHash(), uint64_t seed=0);
+
+	bool operator!() const noexcept { return m_slots == nullptr; }
+	HashId hash_id() const noexcept { return m_hash_id; }
+	uint64_t seed() const noexcept { return m_seed; }
+	// Distinct keys the filter was built from.
+	size_t unique_cnt() const noexcept { return m_unique_cnt; }
+	const uint8_t* data() const noexcept { return reinterpret_cast<const uint8_t*>(m_slots.get()); }
+	size_t data_size() const noexcept { return static_cast<size_t>(m_array_length) * sizeof(Fingerprint); }
+
+	bool test(const uint8_t* data, unsigned len) const noexcept;
+
+private:
+	HashId m_hash_id = HashId::kSpooky;
+	detail::HashFunc m_hash = nullptr;
+	uint64_t m_seed = 0;
+	uint64_t m_fuse_seed = 0;		// picked by the builder
+	uint32_t m_segment_length = 0;
+	uint32_t m_segment_count_length = 0;
+	uint32_t m_array_length = 0;
+	size_t m_unique_cnt = 0;
+	std::unique_ptr<Fingerprint[]> m_slots;
+
+	bool populate(std::vector<uint64_t>& keys);
+};
+
+extern template class BinaryFuseFilter<uint8_t>;
+extern template class BinaryFuseFilter<uint16_t>;
+using BinaryFuse8 = BinaryFuseFilter<uint8_t>;
+using BinaryFuse16 = BinaryFuseFilter<uint16_t>;
+
 } //pbf
 
 #define NEW_BLOOM_FILTER(item, fpr) pbf::Create<pbf::BestWay(fpr)>(item, fpr)
 
+// With PBF_HEADER_ONLY defined, and src/ on the include path, single-key
+// test() and set() of PageBloomFilter and FixedPageBloomFilter are compiled
+// into the caller, default hash included, rather than called in the library.
+// Everything else still links against the library. Build such translation
+// units with the library's PBF_ENABLE_STATS and PBF_ENABLE_AESNI_HASH
+// settings; the PageBloomFilter::pbf_header_only CMake target carries them.
+#ifdef PBF_HEADER_ONLY
+#include "pbf-inline.h"
+#endif
+
 #endif //PAGE_BLOOM_FILTER_H
@@ -32,6 +32,23 @@ def benchmark_pbf():
 
     print("pbf-test: {} ns/op".format(delta / size))
 
+    bf.clear()
+    begin = time.time_ns()
+    bf.set_many(keys[0:size:2])
+    end = time.time_ns()
+    print("pbf-set-many: {} ns/op".format(float(end - begin) / (size/2)))
+
+    begin = time.time_ns()
+    bf.test_many(keys)
+    end = time.time_ns()
+    print("pbf-test-many: {} ns/op".format(float(end - begin) / size))
+
+    packed = b"".join(keys)
+    begin = time.time_ns()
+    bf.test_many(packed, width=8)
+    end = time.time_ns()
+    print("pbf-test-many-packed: {} ns/op".format(float(end - begin) / size))
+
 
 def benchmark_rbloom():
     size = 1000000
@@ -1,4 +1,5 @@
 #define PY_SSIZE_T_CLEAN
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <Python.h>
@@ -321,6 +322,205 @@ static PyObject* PyPageBloomFilter_test(PyPageBloomFilter* self, PyObject* key_o
     return PyBool_FromLong(ret);
 }
 
+/* Keys of a set_many/test_many call, gathered while holding the GIL. */
+typedef struct {
+    Py_ssize_t n;
+    const void* strip;          /* fixed-width keys back to back, or NULL */
+    unsigned width;
+    const void** keys;          /* otherwise one pointer and length per key */
+    unsigned* lens;
+    Py_buffer* views;           /* buffers to release, view_cnt of them */
+    Py_ssize_t view_cnt;
+    Py_buffer strip_view;
+    PyObject* seq;
+} KeyBatch;
+
+static void key_batch_release(KeyBatch* batch) {
+    Py_ssize_t i;
+
+    for (i = 0; i < batch->view_cnt; i++) {
+        PyBuffer_Release(&batch->views[i]);
+    }
+    if (batch->strip_view.obj != NULL) {
+        PyBuffer_Release(&batch->strip_view);
+    }
+    PyMem_Free(batch->keys);
+    PyMem_Free(batch->lens);
+    PyMem_Free(batch->views);
+    Py_XDECREF(batch->seq);
+}
+
+/*
+ * Buffers (e.g. a numpy uint64 array) hold fixed-width keys, `width` bytes each,
+ * defaulting to the item size. Any other iterable yields one str or bytes-like
+ * object per key. The key memory stays pinned until key_batch_release.
+ */
+static int key_batch_init(PyObject* obj, Py_ssize_t width, KeyBatch* batch) {
+    Py_ssize_t i;
+
+    memset(batch, 0, sizeof(*batch));
+    if (!PyUnicode_Check(obj) && PyObject_CheckBuffer(obj)) {
+        if (PyObject_GetBuffer(obj, &batch->strip_view, PyBUF_CONTIG_RO) != 0) {
+            return 0;
+        }
+        if (width <= 0) {
+            width = batch->strip_view.itemsize;
+        }
+        if (width <= 0 || width > UINT_MAX || batch->strip_view.len % width != 0) {
+            PyErr_SetString(PyExc_ValueError, "buffer length must be a multiple of the key width");
+            key_batch_release(batch);
+            return 0;
+        }
+        batch->strip = batch->strip_view.buf;
+        batch->width = (unsigned)width;
+        batch->n = batch->strip_view.len / width;
+        return 1;
+    }
+    if (width > 0) {
+        PyErr_SetString(PyExc_TypeError, "width needs a contiguous buffer of keys");
+        return 0;
+    }
+
+    /* A private tuple keeps every key alive even if the caller's list changes. */
+    batch->seq = PySequence_Tuple(obj);
+    if (batch->seq == NULL) {
+        return 0;
+    }
+    batch->n = PyTuple_GET_SIZE(batch->seq);
+    batch->keys = PyMem_Malloc(sizeof(*batch->keys) * (size_t)(batch->n + 1));
+    batch->lens = PyMem_Malloc(sizeof(*batch->lens) * (size_t)(batch->n + 1));
+    if (batch->keys == NULL || batch->lens == NULL) {
+        key_batch_release(batch);
+        PyErr_NoMemory();
+        return 0;
+    }
+    for (i = 0; i < batch->n; i++) {
+        PyObject* item = PyTuple_GET_ITEM(batch->seq, i);
+        const void* data;
+        Py_ssize_t len;
+
+        if (PyBytes_Check(item)) {
+            data = PyBytes_AS_STRING(item);
+            len = PyBytes_GET_SIZE(item);
+        } else if (PyUnicode_Check(item)) {
+            data = PyUnicode_AsUTF8AndSize(item, &len);
+            if (data == NULL) {
+                key_batch_release(batch);
+                return 0;
+            }
+        } else {
+            Py_buffer* view;
+            if (batch->views == NULL) {
+                batch->views = PyMem_Malloc(sizeof(*batch->views) * (size_t)batch->n);
+                if (batch->views == NULL) {
+                    key_batch_release(batch);
+                    PyErr_NoMemory();
+                    return 0;
+                }
+            }
+            view = &batch->views[batch->view_cnt];
+            if (PyObject_GetBuffer(item, view, PyBUF_CONTIG_RO) != 0) {
+                PyErr_SetString(PyExc_TypeError, "key must be str or a contiguous bytes-like object");
+                key_batch_release(batch);
+                return 0;
+            }
+            batch->view_cnt++;
+            data = view->buf;
+            len = view->len;
+        }
+        if ((size_t)len > UINT_MAX) {
+            PyErr_SetString(PyExc_OverflowError, "key is too long");
+            key_batch_release(batch);
+            return 0;
+        }
+        batch->keys[i] = data;
+        batch->lens[i] = (unsigned)len;
+    }
+    return 1;
+}
+
+/* Runs with the GIL released, so it may only touch memory pinned by the caller. */
+static size_t key_batch_run(pbf_filter* bf, const KeyBatch* batch, int insert, uint8_t* bitmap) {
+    if (batch->strip != NULL) {
+        if (insert) {
+            return pbf_set_strided(bf, batch->strip, batch->width, (size_t)batch->n, bitmap);
+        }
+        pbf_test_strided(bf, batch->strip, batch->width, (size_t)batch->n, bitmap);
+        return 0;
+    }
+    if (insert) {
+        return pbf_set_batch(bf, batch->keys, batch->lens, (size_t)batch->n, bitmap);
+    }
+    pbf_test_batch(bf, batch->keys, batch->lens, (size_t)batch->n, bitmap);
+    return 0;
+}
+
+/*
+ * The C loop runs without the GIL, so threads can probe one filter in
+ * parallel. Inserting concurrently with other calls on the same filter needs
+ * outside locking, as with any bitmap writer.
+ */
+static PyObject* many_impl(PyPageBloomFilter* self, PyObject* args, PyObject* kwargs, int insert) {
+    static char* kwlist[] = {"keys", "width", NULL};
+    PyObject* keys_obj;
+    Py_ssize_t width = 0;
+    KeyBatch batch;
+    PyObject* data;
+    PyObject* mask;
+    uint8_t* bitmap;
+    uint8_t* out;
+    pbf_filter* bf;
+    size_t added;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", kwlist, &keys_obj, &width)) {
+        return NULL;
+    }
+    if (!key_batch_init(keys_obj, width, &batch)) {
+        return NULL;
+    }
+    mask = PyBytes_FromStringAndSize(NULL, batch.n);
+    bitmap = PyMem_Malloc((size_t)(batch.n + 7) / 8 + 1);
+    /* Pin the bitmap: a concurrent __init__ may swap self->data. */
+    data = self->data;
+    Py_INCREF(data);
+    bf = pbf_wrap(self->way, self->page_level, self->page_num, 0, PyByteArray_AS_STRING(data), 0);
+    if (mask == NULL || bitmap == NULL || bf == NULL) {
+        if (mask != NULL) {
+            PyErr_NoMemory();
+        }
+        Py_XDECREF(mask);
+        PyMem_Free(bitmap);
+        pbf_free(bf);
+        Py_DECREF(data);
+        key_batch_release(&batch);
+        return NULL;
+    }
+
+    out = (uint8_t*)PyBytes_AS_STRING(mask);
+    Py_BEGIN_ALLOW_THREADS
+    added = key_batch_run(bf, &batch, insert, bitmap);
+    for (i = 0; i < batch.n; i++) {
+        out[i] = (bitmap[i >> 3] >> (i & 7)) & 1U;
+    }
+    Py_END_ALLOW_THREADS
+
+    self->unique_cnt += added;
+    pbf_free(bf);
+    PyMem_Free(bitmap);
+    Py_DECREF(data);
+    key_batch_release(&batch);
+    return mask;
+}
+
+static PyObject* PyPageBloomFilter_set_many(PyPageBloomFilter* self, PyObject* args, PyObject* kwargs) {
+    return many_impl(self, args, kwargs, 1);
+}
+
+static PyObject* PyPageBloomFilter_test_many(PyPageBloomFilter* self, PyObject* args, PyObject* kwargs) {
+    return many_impl(self, args, kwargs, 0);
+}
+
 static PyObject* PyPageBloomFilter_capacity(PyPageBloomFilter* self, PyObject* Py_UNUSED(ignored)) {
     return PyLong_FromSsize_t((self->data_size * 8) / (Py_ssize_t)self->way);
 }
@@ -402,6 +602,10 @@ static PyMethodDef PyPageBloomFilter_methods[] = {
     {"clear", (PyCFunction)PyPageBloomFilter_clear, METH_NOARGS, "clear buffer"},
     {"set", (PyCFunction)PyPageBloomFilter_set, METH_O, "insert a key"},
     {"test", (PyCFunction)PyPageBloomFilter_test, METH_O, "test a key"},
+    {"set_many", (PyCFunction)(void(*)(void))PyPageBloomFilter_set_many, METH_VARARGS | METH_KEYWORDS,
+     "insert keys, return a bytes mask of the new ones"},
+    {"test_many", (PyCFunction)(void(*)(void))PyPageBloomFilter_test_many, METH_VARARGS | METH_KEYWORDS,
+     "test keys, return a bytes mask of the hits"},
     {"capacity", (PyCFunction)PyPageBloomFilter_capacity, METH_NOARGS, "return nominal capacity"},
     {"virtual_capacity", (PyCFunction)PyPageBloomFilter_virtual_capacity, METH_VARARGS,
      "estimate capacity by false-positive rate"},
@@ -43,6 +43,19 @@ class PageBloomFilter:
     def test(self, key):
         return self._native.test(key)
 
+    def set_many(self, keys, width=0):
+        """Insert keys and return a bytes mask, 1 where a key was new.
+
+        `keys` is an iterable of str/bytes, or a contiguous buffer of
+        fixed-width keys such as a numpy uint64 array (`width` defaults to the
+        item size). The native loop runs without the GIL.
+        """
+        return self._native.set_many(keys, width)
+
+    def test_many(self, keys, width=0):
+        """Test keys and return a bytes mask, 1 where a key may be present."""
+        return self._native.test_many(keys, width)
+
     def capacity(self):
         return self._native.capacity()
 
@@ -164,8 +177,39 @@ def _test_stable_bitmap_layout():
     assert bf.data == expected
 
 
+def _test_many():
+    bf = PageBloomFilter(6, 9, 40)
+    keys = [struct.pack("<q", i) for i in range(300)]
+    mask = bf.set_many(keys[:200])
+    assert mask == b"\x01" * 200
+    assert bf.unique_cnt == 200
+    assert bf.set_many([keys[0], "x", bytearray(b"y"), memoryview(b"x")]) == b"\x00\x01\x01\x00"
+    assert bf.unique_cnt == 202
+
+    mask = bf.test_many(keys)
+    assert mask[:200] == b"\x01" * 200
+    assert mask == bytes(bf.test(k) for k in keys)
+    assert bf.test_many(["x", b"y", b""]) == bytes((1, 1, bf.test(b"")))
+    assert bf.test_many([]) == b""
+
+    packed = b"".join(keys)
+    assert bf.test_many(packed, width=8) == mask
+    assert bf.test_many(memoryview(packed).cast("q")) == mask
+    before = bf.test_many(keys[200:])
+    assert bf.set_many(memoryview(packed[1600:]).cast("Q")) == bytes(1 - b for b in before)
+    assert bf.test_many(packed, width=8) == b"\x01" * 300
+    for bad in ((packed, 7), ([b"a"], 8)):
+        try:
+            bf.test_many(*bad)
+        except (ValueError, TypeError):
+            pass
+        else:
+            raise AssertionError("bad key batch must be rejected")
+
+
 def test():
     _test_create()
+    _test_many()
     _test_page_num_limit()
     _test_stable_bitmap_layout()
     for i in range(4, 9):
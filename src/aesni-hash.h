@@ -20,8 +20,8 @@
 extern "C" {
 #endif
 
-static __m128i AESNI_Hash128(const uint8_t* msg, unsigned len, uint32_t seed = 0) {
-	auto a = _mm_set1_epi32(seed);
+static __m128i AESNI_Hash128(const uint8_t* msg, unsigned len, uint64_t seed = 0) {
+	auto a = _mm_set1_epi64x((long long)seed);
 	auto b = _mm_set1_epi32(len);
 	auto m = _mm_set_epi32(0xdeadbeef, 0xffff0000, 0x01234567, 0x89abcdef);
 	auto s = _mm_set_epi8(3, 7, 11, 15, 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12);
@@ -156,7 +156,7 @@ static __m128i AESNI_Hash128(const uint8_t* msg, unsigned len, uint32_t seed = 0
 	return _mm_aesenc_si128(a, b);
 }
 
-static inline uint64_t AESNI_Hash64(const uint8_t* msg, unsigned len, uint32_t seed = 0) {
+static inline uint64_t AESNI_Hash64(const uint8_t* msg, unsigned len, uint64_t seed = 0) {
 	union {
 		uint64_t x[2];
 		__m128i v;
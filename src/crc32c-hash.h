@@ -0,0 +1,102 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+#ifndef CRC32C_HASH_H
+#define CRC32C_HASH_H
+
+#include "hash.h"
+
+// 128-bit key hash built around the CRC32C instruction, for hosts where it is
+// the cheapest mixing primitive (ARMv8, x86 without AES-NI). CRC is linear and
+// keeps 32 bits per lane, so every block also feeds a multiplicative lane and
+// the state is finished with a 64-bit avalanche. `Crc` supplies the 8-byte
+// CRC32C step; the instruction and table variants give identical output.
+
+namespace pbf {
+
+struct CRC32CTable {
+	uint32_t v[256];
+	constexpr CRC32CTable() : v() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (unsigned k = 0; k < 8; k++) {
+				c = (c >> 1U) ^ (0x82f63b78U & (0U - (c & 1U)));
+			}
+			v[i] = c;
+		}
+	}
+};
+
+// Portable fallback, one byte per table lookup.
+struct SoftCRC32C {
+	static FORCE_INLINE uint32_t u64(uint32_t crc, uint64_t v) noexcept {
+		static constexpr CRC32CTable table;
+		for (unsigned i = 0; i < 8; i++) {
+			crc = table.v[(crc ^ static_cast<uint32_t>(v)) & 0xffU] ^ (crc >> 8U);
+			v >>= 8U;
+		}
+		return crc;
+	}
+};
+
+static FORCE_INLINE uint64_t CRC32C_Fmix(uint64_t x) noexcept {
+	x ^= x >> 33U;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33U;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33U;
+	return x;
+}
+
+// Little-endian load of n < 8 bytes without touching bytes past the key.
+static FORCE_INLINE uint64_t CRC32C_Tail(const uint8_t* msg, unsigned n) noexcept {
+	if (n >= 4) {
+		uint64_t lo = *(const uint32_t*)msg;
+		uint64_t hi = *(const uint32_t*)(msg + n - 4);
+		return lo | (hi << ((n - 4) * 8U));
+	}
+	if (n == 0) {
+		return 0;
+	}
+	return (uint64_t)msg[0] | ((uint64_t)msg[n >> 1U] << ((n >> 1U) * 8U))
+		   | ((uint64_t)msg[n - 1] << ((n - 1) * 8U));
+}
+
+template <typename Crc>
+static FORCE_INLINE V128 CRC32C_Hash128(const uint8_t* msg, unsigned len, uint64_t seed=0) noexcept {
+	constexpr uint64_t k0 = 0x9e3779b97f4a7c15ULL;
+	constexpr uint64_t k1 = 0xc2b2ae3d27d4eb4fULL;
+	uint32_t c0 = 0x6a09e667U ^ static_cast<uint32_t>(seed);
+	uint32_t c1 = 0xbb67ae85U ^ static_cast<uint32_t>(seed >> 32U);
+	uint64_t m = k1 ^ len ^ seed;
+
+	for (auto end = msg + (len&~0xfU); msg < end; msg += 16) {
+		auto x = (const uint64_t*)msg;
+		c0 = Crc::u64(c0, x[0]);
+		c1 = Crc::u64(c1, x[1]);
+		m = ((m + x[0]) * k0) ^ x[1];
+	}
+
+	// The last block is always mixed, zero-padded, so the empty key is covered.
+	uint64_t x0, x1 = 0;
+	unsigned rest = len & 0xfU;
+	if (rest >= 8) {
+		x0 = *(const uint64_t*)msg;
+		x1 = CRC32C_Tail(msg + 8, rest - 8);
+	} else {
+		x0 = CRC32C_Tail(msg, rest);
+	}
+	c0 = Crc::u64(c0, x0);
+	c1 = Crc::u64(c1, x1);
+	m = ((m + x0) * k0) ^ x1;
+
+	uint64_t c = ((uint64_t)c1 << 32U) | c0;
+	uint64_t a = CRC32C_Fmix(m ^ c);
+	uint64_t b = CRC32C_Fmix((m ^ k0) + ((c << 29U) | (c >> 35U)) + a);
+	return {a, b};
+}
+
+} //pbf
+#endif // CRC32C_HASH_H
@@ -0,0 +1,123 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Hash backends that need instruction set extensions. The build compiles this
+// file alone with those extensions enabled, so nothing here may run before
+// the CPU check passes.
+
+#include "hash-select.h"
+#include "crc32c-hash.h"
+
+#if defined(PBF_ARCH_X86_64) && (defined(_MSC_VER) || (defined(__AES__) && defined(__SSSE3__) && defined(__SSE4_2__)))
+#define PBF_X86_ACCEL 1
+#include <nmmintrin.h>
+#include "aesni-hash.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(PBF_ARCH_AARCH64) && (defined(_MSC_VER) || defined(__ARM_FEATURE_CRC32))
+#define PBF_ARM_CRC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#endif
+#endif
+
+namespace pbf {
+
+#if defined(PBF_X86_ACCEL)
+
+namespace {
+
+struct SSE42CRC32C {
+	static FORCE_INLINE uint32_t u64(uint32_t crc, uint64_t v) noexcept {
+		return static_cast<uint32_t>(_mm_crc32_u64(crc, v));
+	}
+};
+
+static detail::Hash128 AESNIBackend(const uint8_t* msg, unsigned len, uint64_t seed) {
+	union {
+		detail::Hash128 v;
+		__m128i m;
+	} t;
+	t.m = AESNI_Hash128(msg, len, seed);
+	return t.v;
+}
+
+static detail::Hash128 SSE42CRC32CBackend(const uint8_t* msg, unsigned len, uint64_t seed) {
+	auto v = CRC32C_Hash128<SSE42CRC32C>(msg, len, seed);
+	return {v.l, v.h};
+}
+
+// cpuid leaf 1 ecx: ssse3 bit 9, sse4.2 bit 20, aes bit 25.
+static uint32_t CpuFeatures() noexcept {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return static_cast<uint32_t>(info[2]);
+#else
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return 0;
+	}
+	return ecx;
+#endif
+}
+
+constexpr uint32_t kSSSE3 = 1U << 9U;
+constexpr uint32_t kSSE42 = 1U << 20U;
+constexpr uint32_t kAES = 1U << 25U;
+
+} // namespace
+
+detail::HashFunc AESNIHashFunc() noexcept {
+	constexpr uint32_t need = kSSSE3 | kSSE42 | kAES;
+	return (CpuFeatures() & need) == need ? AESNIBackend : nullptr;
+}
+
+detail::HashFunc CRC32CHashFunc() noexcept {
+	return (CpuFeatures() & kSSE42) != 0 ? SSE42CRC32CBackend : nullptr;
+}
+
+#elif defined(PBF_ARM_CRC)
+
+namespace {
+
+struct ArmCRC32C {
+	static FORCE_INLINE uint32_t u64(uint32_t crc, uint64_t v) noexcept {
+		return __crc32cd(crc, v);
+	}
+};
+
+static detail::Hash128 ArmCRC32CBackend(const uint8_t* msg, unsigned len, uint64_t seed) {
+	auto v = CRC32C_Hash128<ArmCRC32C>(msg, len, seed);
+	return {v.l, v.h};
+}
+
+} // namespace
+
+detail::HashFunc AESNIHashFunc() noexcept {
+	return nullptr;
+}
+
+detail::HashFunc CRC32CHashFunc() noexcept {
+	return ArmCRC32CBackend;
+}
+
+#else
+
+detail::HashFunc AESNIHashFunc() noexcept {
+	return nullptr;
+}
+
+detail::HashFunc CRC32CHashFunc() noexcept {
+	return nullptr;
+}
+
+#endif
+
+} //pbf
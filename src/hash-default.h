@@ -0,0 +1,51 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+#ifndef PAGE_BLOOM_FILTER_HASH_DEFAULT_H
+#define PAGE_BLOOM_FILTER_HASH_DEFAULT_H
+
+#include "hash.h"
+#if defined(USE_AESNI_HASH)
+#include "aesni-hash.h"
+#elif defined(USE_XXHASH)
+#define XXH_INLINE_ALL
+#include "xxh3.h"
+#else
+#include "spooky-hash.h"
+#endif
+
+namespace pbf {
+
+// The hash this build defaults to, behind both Hash() and DefaultHash(), in a
+// form callers can inline. kBuildHashId is its HashId value; this header stays
+// free of pbf.h for the freestanding builds that include hash.cc.
+#if defined(USE_AESNI_HASH)
+constexpr unsigned kBuildHashId = 2;
+
+static FORCE_INLINE V128 BuildHash(const uint8_t* msg, unsigned len, uint64_t seed) noexcept {
+	union {
+		V128 v;
+		__m128i m;
+	} t;
+	t.m = AESNI_Hash128(msg, len, seed);
+	return t.v;
+}
+#elif defined(USE_XXHASH)
+constexpr unsigned kBuildHashId = 1;
+
+static FORCE_INLINE V128 BuildHash(const uint8_t* msg, unsigned len, uint64_t seed) noexcept {
+	auto ret = XXH3_128bits_withSeed(msg, len, seed);
+	return {ret.low64, ret.high64};
+}
+#else
+constexpr unsigned kBuildHashId = 0;
+
+static FORCE_INLINE V128 BuildHash(const uint8_t* msg, unsigned len, uint64_t seed) noexcept {
+	return SpookyHash128(msg, len, seed);
+}
+#endif
+
+} //pbf
+#endif // PAGE_BLOOM_FILTER_HASH_DEFAULT_H
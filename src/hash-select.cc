@@ -0,0 +1,84 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "hash-select.h"
+#include "spooky-hash.h"
+#include "crc32c-hash.h"
+#if defined(__has_include)
+#if __has_include("xxh3.h")
+#define PBF_HAVE_XXH3 1
+#define XXH_INLINE_ALL
+#include "xxh3.h"
+#endif
+#endif
+
+namespace pbf {
+
+namespace {
+
+static detail::Hash128 SpookyBackend(const uint8_t* msg, unsigned len, uint64_t seed) {
+	auto v = SpookyHash128(msg, len, seed);
+	return {v.l, v.h};
+}
+
+static detail::Hash128 SoftCRC32CBackend(const uint8_t* msg, unsigned len, uint64_t seed) {
+	auto v = CRC32C_Hash128<SoftCRC32C>(msg, len, seed);
+	return {v.l, v.h};
+}
+
+#ifdef PBF_HAVE_XXH3
+static detail::Hash128 XXH3Backend(const uint8_t* msg, unsigned len, uint64_t seed) {
+	auto ret = XXH3_128bits_withSeed(msg, len, seed);
+	return {ret.low64, ret.high64};
+}
+#endif
+
+constexpr unsigned kHashNum = 4;
+
+struct HashTable {
+	detail::HashFunc func[kHashNum] = {};
+	HashTable() noexcept {
+		func[static_cast<unsigned>(HashId::kSpooky)] = SpookyBackend;
+#ifdef PBF_HAVE_XXH3
+		func[static_cast<unsigned>(HashId::kXXH3)] = XXH3Backend;
+#endif
+		func[static_cast<unsigned>(HashId::kAESNI)] = AESNIHashFunc();
+		auto crc = CRC32CHashFunc();
+		func[static_cast<unsigned>(HashId::kCRC32C)] = crc != nullptr ? crc : SoftCRC32CBackend;
+	}
+};
+
+} // namespace
+
+detail::HashFunc ResolveHash(HashId id) noexcept {
+	static const HashTable table;
+	auto i = static_cast<unsigned>(id);
+	return i < kHashNum ? table.func[i] : nullptr;
+}
+
+HashId DefaultHash() noexcept {
+#if defined(USE_AESNI_HASH)
+	return HashId::kAESNI;
+#elif defined(USE_XXHASH)
+	return HashId::kXXH3;
+#else
+	return HashId::kSpooky;
+#endif
+}
+
+bool HashAvailable(HashId id) noexcept {
+	return ResolveHash(id) != nullptr;
+}
+
+const char* HashName(HashId id) noexcept {
+	switch (id) {
+		case HashId::kSpooky: return "spooky";
+		case HashId::kXXH3: return "xxh3";
+		case HashId::kAESNI: return "aesni";
+		case HashId::kCRC32C: return "crc32c";
+	}
+	return "unknown";
+}
+
+} //pbf
@@ -0,0 +1,28 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+#ifndef PAGE_BLOOM_FILTER_HASH_SELECT_H
+#define PAGE_BLOOM_FILTER_HASH_SELECT_H
+
+#include "pbf.h"
+#include "hash.h"
+
+namespace pbf {
+
+// nullptr when the build or the CPU cannot run the hash.
+extern detail::HashFunc ResolveHash(HashId id) noexcept;
+
+// Backends compiled with ISA flags in hash-accel.cc, nullptr when unsupported.
+extern detail::HashFunc AESNIHashFunc() noexcept;
+extern detail::HashFunc CRC32CHashFunc() noexcept;
+
+static FORCE_INLINE V128 HashWith(detail::HashFunc hash, const uint8_t* msg, unsigned len,
+								  uint64_t seed) noexcept {
+	auto h = hash(msg, len, seed);
+	return {h.l, h.h};
+}
+
+} //pbf
+#endif // PAGE_BLOOM_FILTER_HASH_SELECT_H
@@ -26,7 +26,8 @@ struct V128 {
 
 static_assert(sizeof(V128) == 16, "V128 must remain 128 bits");
 
-extern V128 Hash(const uint8_t* msg, unsigned len) noexcept;
+// Seed 0 is the standard hash shared with the other bindings.
+extern V128 Hash(const uint8_t* msg, unsigned len, uint64_t seed=0) noexcept;
 
 } //pbf
 #endif // PAGE_BLOOM_FILTER_HASH_H
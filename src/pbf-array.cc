@@ -0,0 +1,184 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include "pbf.h"
+#include "pbf-internal.h"
+#include "hash-select.h"
+
+namespace pbf {
+
+namespace {
+
+template <unsigned N>
+using Way = std::integral_constant<unsigned, N>;
+
+// Call op(Way<N>{}) for the runtime way, so every probe loop is compiled for a
+// fixed N.
+template <typename Op>
+static FORCE_INLINE auto Dispatch(unsigned way, Op&& op) -> decltype(op(Way<8>{})) {
+	switch (way) {
+		case 4: return op(Way<4>{});
+		case 5: return op(Way<5>{});
+		case 6: return op(Way<6>{});
+		case 7: return op(Way<7>{});
+		default: return op(Way<8>{});
+	}
+}
+
+struct Layout {
+	uint8_t* space;
+	size_t count;
+	size_t filter_size;
+	unsigned page_level;
+	Divisor<uint32_t> page_num;
+	detail::HashFunc hash;
+	uint64_t seed;
+
+	V128 hash_key(const uint8_t* data, unsigned len) const noexcept {
+		return HashWith(hash, data, len, seed);
+	}
+	uint8_t* page(size_t id, V128X t) const noexcept {
+		size_t idx = PageHash(t) % page_num;
+		return space + id * filter_size + (idx << page_level);
+	}
+	// nullptr for an invalid key or id.
+	uint8_t* locate(size_t id, const uint8_t* data, unsigned len, V128X& t) const noexcept {
+		data = CheckKey(data, len);
+		if (data == nullptr || id >= count) {
+			return nullptr;
+		}
+		t.v = hash_key(data, len);
+		return page(id, t);
+	}
+};
+
+template <unsigned N, bool Insert, typename KeyAt, typename Emit>
+static size_t Batch(const Layout& layout, const size_t* ids, KeyAt key_at, size_t n, const Emit& emit) noexcept {
+	auto hash_key = [&layout](const uint8_t* data, unsigned len) { return layout.hash_key(data, len); };
+	return ProbeBatch<N, Insert>(n, layout.page_level,
+		[&](size_t i, size_t m, V128X* t, bool* valid) { HashEach(key_at, i, m, hash_key, t, valid); },
+		[&](size_t i, V128X t) { return ids[i] < layout.count ? layout.page(ids[i], t) : nullptr; },
+		emit);
+}
+
+} // namespace
+
+BloomFilterArray::BloomFilterArray(size_t count, unsigned way, unsigned page_level, unsigned page_num,
+								   HashId hash, uint64_t seed, MemoryResource* resource) {
+	auto func = ResolveHash(hash);
+	if (func == nullptr || count == 0 || way < 4 || way > 8 || page_level < (8-8/way) || page_level > 13
+		|| page_num == 0 || page_num >= kMaxPageNum) {
+		return;
+	}
+	const size_t filter_size = static_cast<size_t>(page_num) << page_level;
+	if (count > SIZE_MAX / filter_size) {
+		return;
+	}
+	if (resource == nullptr) {
+		resource = DefaultMemoryResource();
+	}
+	const size_t total = count * filter_size;
+	auto space = static_cast<uint8_t*>(resource->allocate(total, detail::kSpaceAlign));
+	if (space == nullptr) {
+		return;
+	}
+	if (!resource->zeroed()) {
+		memset(space, 0, total);
+	}
+	m_space = std::unique_ptr<uint8_t[], detail::SpaceDeleter>(space, detail::SpaceDeleter{resource, total});
+	m_count = count;
+	m_way = way;
+	m_page_level = page_level;
+	m_page_num = page_num;
+	m_hash_id = hash;
+	m_hash = func;
+	m_seed = seed;
+}
+
+#define PBF_ARRAY_LAYOUT \
+	Layout{m_space.get(), m_count, filter_size(), m_page_level, m_page_num, m_hash, m_seed}
+
+bool BloomFilterArray::test(size_t id, const uint8_t* data, unsigned len) const noexcept {
+	V128X t;
+	auto page = PBF_ARRAY_LAYOUT.locate(id, data, len, t);
+	if (page == nullptr) {
+		return false;
+	}
+	return Dispatch(m_way, [&](auto w) { return Test<decltype(w)::value>(page, m_page_level, t); });
+}
+
+bool BloomFilterArray::set(size_t id, const uint8_t* data, unsigned len) noexcept {
+	V128X t;
+	auto page = PBF_ARRAY_LAYOUT.locate(id, data, len, t);
+	if (page == nullptr) {
+		return false;
+	}
+	return Dispatch(m_way, [&](auto w) { return Set<decltype(w)::value>(page, m_page_level, t); });
+}
+
+void BloomFilterArray::test_batch(const size_t* ids, const uint8_t* const* keys, const unsigned* lens, size_t n,
+								  bool* out) const noexcept {
+	const auto layout = PBF_ARRAY_LAYOUT;
+	Dispatch(m_way, [&](auto w) {
+		return Batch<decltype(w)::value, false>(layout, ids, KeyList<>{keys, lens}, n, EmitBools{out});
+	});
+}
+
+size_t BloomFilterArray::set_batch(const size_t* ids, const uint8_t* const* keys, const unsigned* lens,
+								   size_t n) noexcept {
+	const auto layout = PBF_ARRAY_LAYOUT;
+	return Dispatch(m_way, [&](auto w) {
+		return Batch<decltype(w)::value, true>(layout, ids, KeyList<>{keys, lens}, n, EmitNothing{});
+	});
+}
+
+void BloomFilterArray::test_batch(const size_t* ids, const uint8_t* keys, unsigned len, size_t n,
+								  bool* out) const noexcept {
+	const auto layout = PBF_ARRAY_LAYOUT;
+	Dispatch(m_way, [&](auto w) {
+		return Batch<decltype(w)::value, false>(layout, ids, KeyStrip{keys, len}, n, EmitBools{out});
+	});
+}
+
+size_t BloomFilterArray::set_batch(const size_t* ids, const uint8_t* keys, unsigned len, size_t n) noexcept {
+	const auto layout = PBF_ARRAY_LAYOUT;
+	return Dispatch(m_way, [&](auto w) {
+		return Batch<decltype(w)::value, true>(layout, ids, KeyStrip{keys, len}, n, EmitNothing{});
+	});
+}
+
+#undef PBF_ARRAY_LAYOUT
+
+void BloomFilterArray::clear(size_t id) noexcept {
+	if (id < m_count && !m_space.get_deleter().resource->discard(m_space.get() + id * filter_size(),
+																	  filter_size())) {
+		memset(m_space.get() + id * filter_size(), 0, filter_size());
+	}
+}
+
+void BloomFilterArray::clear() noexcept {
+	if (m_space != nullptr && !m_space.get_deleter().resource->discard(m_space.get(), m_count * filter_size())) {
+		memset(m_space.get(), 0, m_count * filter_size());
+	}
+}
+
+bool BloomFilterArray::load(size_t id, const uint8_t* data) noexcept {
+	if (id >= m_count || data == nullptr) {
+		return false;
+	}
+	memcpy(m_space.get() + id * filter_size(), data, filter_size());
+	return true;
+}
+
+std::unique_ptr<BloomFilter> BloomFilterArray::extract(size_t id, MemoryResource* resource) const {
+	if (id >= m_count) {
+		return nullptr;
+	}
+	return New(m_way, m_page_level, m_page_num.value(), 0, data(id), m_hash_id, m_seed, resource);
+}
+
+} //pbf
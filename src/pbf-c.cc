@@ -6,36 +6,61 @@
 #include "pbf-internal.h"
 #ifdef C_ALL_IN_ONE
 #include "hash.cc"
+#else
+#include <cstdlib>
+#include <cstring>
 #endif
 
+namespace {
+
+template <unsigned N>
+static FORCE_INLINE bool SetKey(void* space, unsigned page_level, unsigned page_num,
+								const void* key, unsigned len, uint64_t seed) {
+	auto data = pbf::CheckKey((const uint8_t*)key, len);
+	if (data == nullptr) {
+		return false;
+	}
+	pbf::V128X t;
+	t.v = pbf::Hash(data, len, seed);
+	size_t idx = PageHash(t) % page_num;
+	auto page = ((uint8_t*)space) + (idx << page_level);
+	return pbf::Set<N>(page, page_level, t);
+}
+
+template <unsigned N>
+static FORCE_INLINE bool TestKey(const void* space, unsigned page_level, unsigned page_num,
+								 const void* key, unsigned len, uint64_t seed) {
+	auto data = pbf::CheckKey((const uint8_t*)key, len);
+	if (data == nullptr) {
+		return false;
+	}
+	pbf::V128X t;
+	t.v = pbf::Hash(data, len, seed);
+	size_t idx = PageHash(t) % page_num;
+	auto page = ((const uint8_t*)space) + (idx << page_level);
+	return pbf::Test<N>(page, page_level, t);
+}
+
+} // namespace
+
 extern "C" {
 
 #define PAGE_BLOOM_FILTER_FUNC(way) \
 bool PBF##way##_Set(void* space, unsigned page_level, unsigned page_num,        \
 	const void* key, unsigned len) {                                            \
-	if (key == nullptr) {                                                      \
-		if (len != 0) return false;                                               \
-		static const uint8_t empty_key = 0;                                       \
-		key = &empty_key;                                                         \
-	}                                                                          \
-	pbf::V128X t;                                                               \
-	t.v = pbf::Hash((const uint8_t*)key, len);                                  \
-	size_t idx = PageHash(t) % page_num;                                        \
-	auto page = ((uint8_t*)space) + (idx << page_level);                        \
-	return pbf::Set< way >(page, page_level, t);                                \
+	return SetKey< way >(space, page_level, page_num, key, len, 0);             \
 } \
 bool PBF##way##_Test(const void* space, unsigned page_level, unsigned page_num, \
 	const void* key, unsigned len) {                                            \
-	if (key == nullptr) {                                                      \
-		if (len != 0) return false;                                               \
-		static const uint8_t empty_key = 0;                                       \
-		key = &empty_key;                                                         \
-	}                                                                          \
-	pbf::V128X t;                                                               \
-	t.v = pbf::Hash((const uint8_t*)key, len);                                  \
-	size_t idx = PageHash(t) % page_num;                                        \
-	auto page = ((uint8_t*)space) + (idx << page_level);                        \
-	return pbf::Test< way >(page, page_level, t);                               \
+	return TestKey< way >(space, page_level, page_num, key, len, 0);            \
+} \
+bool PBF##way##_SetWithSeed(void* space, unsigned page_level, unsigned page_num, \
+	const void* key, unsigned len, uint64_t seed) {                              \
+	return SetKey< way >(space, page_level, page_num, key, len, seed);           \
+} \
+bool PBF##way##_TestWithSeed(const void* space, unsigned page_level,             \
+	unsigned page_num, const void* key, unsigned len, uint64_t seed) {           \
+	return TestKey< way >(space, page_level, page_num, key, len, seed);          \
 }
 
 PAGE_BLOOM_FILTER_FUNC(4)
@@ -45,4 +70,310 @@ PAGE_BLOOM_FILTER_FUNC(7)
 PAGE_BLOOM_FILTER_FUNC(8)
 
 #undef PAGE_BLOOM_FILTER_FUNC
-}
\ No newline at end of file
+}
+
+struct pbf_filter {
+	uint8_t* space;
+	uint64_t seed;
+	uint64_t fac;			// page_num reciprocal, see PageOffset
+	size_t unique_cnt;
+	unsigned way;
+	unsigned page_level;
+	unsigned page_num;
+	bool owned;
+};
+
+namespace {
+
+constexpr unsigned kMaxPageNum = 1U << 18U;
+
+// Lemire-Kaser-Kurz remainder as in pbf::Divisor, with the 64x32 high product
+// split into 32-bit halves so no 128-bit multiply is needed.
+static FORCE_INLINE size_t PageOffset(const pbf_filter* bf, pbf::V128X t) {
+	uint64_t low = bf->fac * PageHash(t);
+	uint64_t idx = ((low >> 32U) * bf->page_num + (((low & 0xffffffffU) * bf->page_num) >> 32U)) >> 32U;
+	return static_cast<size_t>(idx) << bf->page_level;
+}
+
+static FORCE_INLINE bool ValidGeometry(unsigned way, unsigned page_level, unsigned page_num) {
+	return way >= 4 && way <= 8 && page_level >= (8-8/way) && page_level <= 13
+		   && page_num != 0 && page_num < kMaxPageNum;
+}
+
+static FORCE_INLINE void InitHandle(pbf_filter* bf, unsigned way, unsigned page_level, unsigned page_num,
+									uint64_t seed, uint8_t* space) {
+	bf->space = space;
+	bf->seed = seed;
+	bf->fac = UINT64_MAX / page_num + 1;
+	bf->unique_cnt = 0;
+	bf->way = way;
+	bf->page_level = page_level;
+	bf->page_num = page_num;
+	bf->owned = false;
+}
+
+static FORCE_INLINE pbf::V128 HashKey(const uint8_t* data, unsigned len, uint64_t seed) {
+	return pbf::Hash(data, len, seed);
+}
+
+template <typename KeyAt>
+static FORCE_INLINE void HashWindow(const KeyAt& key_at, size_t i, size_t m, uint64_t seed,
+									pbf::V128X* t, bool* valid) {
+	pbf::HashEach(key_at, i, m, [seed](const uint8_t* data, unsigned len) { return HashKey(data, len, seed); },
+				  t, valid);
+}
+
+#ifdef PBF_SPOOKY_X2
+// Fixed-width keys share a length, so pairs of them go through the 64x2 lanes.
+static FORCE_INLINE void HashWindow(const pbf::KeyStrip& key_at, size_t i, size_t m, uint64_t seed,
+									pbf::V128X* t, bool* valid) {
+	if (key_at.keys == nullptr) {
+		pbf::HashEach(key_at, i, m, [seed](const uint8_t* data, unsigned len) { return HashKey(data, len, seed); },
+					  t, valid);
+		return;
+	}
+	auto key = key_at.keys + i * key_at.len;
+	size_t j = 0;
+	for (; j + 1 < m; j += 2, key += 2 * key_at.len) {
+		pbf::V128 h[2];
+		pbf::SpookyHash128x2<pbf::U64x2>(key, key + key_at.len, key_at.len, seed, h);
+		t[j].v = h[0];
+		t[j+1].v = h[1];
+		valid[j] = valid[j+1] = true;
+	}
+	if (j < m) {
+		t[j].v = pbf::Hash(key, key_at.len, seed);
+		valid[j] = true;
+	}
+}
+#endif
+
+// Returns the number of hits, which for Set means newly added keys, and
+// writes one bit per key to `bitmap` when it is not null.
+template <unsigned N, bool Set, typename KeyAt>
+static size_t Batch(const pbf_filter* bf, KeyAt key_at, size_t n, uint8_t* bitmap) {
+	return pbf::ProbeBatch<N, Set>(n, bf->page_level,
+		[&](size_t i, size_t m, pbf::V128X* t, bool* valid) { HashWindow(key_at, i, m, bf->seed, t, valid); },
+		[bf](size_t, pbf::V128X t) { return bf->space + PageOffset(bf, t); },
+		[bitmap](size_t i, size_t m, uint32_t bits) {
+			if (bitmap != nullptr) {
+				for (size_t j = 0; j < m; j += 8) {
+					bitmap[(i+j)/8] = static_cast<uint8_t>(bits >> j);
+				}
+			}
+		});
+}
+
+template <bool Set, typename KeyAt>
+static size_t BatchOf(const pbf_filter* bf, KeyAt key_at, size_t n, uint8_t* bitmap) {
+	if (bf == nullptr) {
+		return 0;
+	}
+	switch (bf->way) {
+		case 4: return Batch<4, Set>(bf, key_at, n, bitmap);
+		case 5: return Batch<5, Set>(bf, key_at, n, bitmap);
+		case 6: return Batch<6, Set>(bf, key_at, n, bitmap);
+		case 7: return Batch<7, Set>(bf, key_at, n, bitmap);
+		default: return Batch<8, Set>(bf, key_at, n, bitmap);
+	}
+}
+
+template <typename KeyAt>
+static size_t SetBatch(pbf_filter* bf, KeyAt key_at, size_t n, uint8_t* bitmap) {
+	auto cnt = BatchOf<true>(bf, key_at, n, bitmap);
+	if (bf != nullptr) {
+		bf->unique_cnt += cnt;
+	}
+	return cnt;
+}
+
+} // namespace
+
+extern "C" {
+
+#define PAGE_BLOOM_FILTER_FUNC(way) \
+size_t PBF##way##_SetStrided(void* space, unsigned page_level, unsigned page_num,                  \
+	const void* keys, unsigned len, size_t n, uint8_t* bitmap) {                                 \
+	pbf_filter bf;                                                                               \
+	InitHandle(&bf, way, page_level, page_num, 0, (uint8_t*)space);                              \
+	return Batch< way, true >(&bf, pbf::KeyStrip{(const uint8_t*)keys, len}, n, bitmap);         \
+} \
+void PBF##way##_TestStrided(const void* space, unsigned page_level, unsigned page_num,             \
+	const void* keys, unsigned len, size_t n, uint8_t* bitmap) {                                 \
+	pbf_filter bf;                                                                               \
+	InitHandle(&bf, way, page_level, page_num, 0, (uint8_t*)space);                              \
+	Batch< way, false >(&bf, pbf::KeyStrip{(const uint8_t*)keys, len}, n, bitmap);               \
+} \
+size_t PBF##way##_SetOffsets(void* space, unsigned page_level, unsigned page_num,                  \
+	const void* buf, const size_t* offsets, size_t n, uint8_t* bitmap) {                         \
+	pbf_filter bf;                                                                               \
+	InitHandle(&bf, way, page_level, page_num, 0, (uint8_t*)space);                              \
+	return Batch< way, true >(&bf, pbf::KeyOffsets{(const uint8_t*)buf, offsets}, n, bitmap);    \
+} \
+void PBF##way##_TestOffsets(const void* space, unsigned page_level, unsigned page_num,             \
+	const void* buf, const size_t* offsets, size_t n, uint8_t* bitmap) {                         \
+	pbf_filter bf;                                                                               \
+	InitHandle(&bf, way, page_level, page_num, 0, (uint8_t*)space);                              \
+	Batch< way, false >(&bf, pbf::KeyOffsets{(const uint8_t*)buf, offsets}, n, bitmap);          \
+}
+
+PAGE_BLOOM_FILTER_FUNC(4)
+PAGE_BLOOM_FILTER_FUNC(5)
+PAGE_BLOOM_FILTER_FUNC(6)
+PAGE_BLOOM_FILTER_FUNC(7)
+PAGE_BLOOM_FILTER_FUNC(8)
+
+#undef PAGE_BLOOM_FILTER_FUNC
+
+bool PBF_Fold(void* space, unsigned page_level, unsigned page_num, unsigned factor) {
+	if (factor == 0 || page_num % factor != 0) {
+		return false;
+	}
+	pbf::FoldPages((uint8_t*)space, static_cast<size_t>(page_num / factor) << page_level, factor);
+	return true;
+}
+}
+
+#ifndef C_ALL_IN_ONE
+
+namespace {
+
+static pbf_filter* NewHandle(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed) {
+	if (!ValidGeometry(way, page_level, page_num)) {
+		return nullptr;
+	}
+	auto bf = static_cast<pbf_filter*>(malloc(sizeof(pbf_filter)));
+	if (bf != nullptr) {
+		InitHandle(bf, way, page_level, page_num, seed, nullptr);
+	}
+	return bf;
+}
+
+} // namespace
+
+extern "C" {
+
+pbf_filter* pbf_create(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed) {
+	auto bf = NewHandle(way, page_level, page_num, seed);
+	if (bf == nullptr) {
+		return nullptr;
+	}
+	bf->space = static_cast<uint8_t*>(calloc(pbf_data_size(bf), 1));
+	if (bf->space == nullptr) {
+		free(bf);
+		return nullptr;
+	}
+	bf->owned = true;
+	return bf;
+}
+
+pbf_filter* pbf_restore(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed,
+						const void* data, size_t unique_cnt) {
+	if (data == nullptr) {
+		return nullptr;
+	}
+	auto bf = pbf_create(way, page_level, page_num, seed);
+	if (bf == nullptr) {
+		return nullptr;
+	}
+	memcpy(bf->space, data, pbf_data_size(bf));
+	bf->unique_cnt = unique_cnt;
+	return bf;
+}
+
+pbf_filter* pbf_wrap(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed,
+					 void* space, size_t unique_cnt) {
+	if (space == nullptr) {
+		return nullptr;
+	}
+	auto bf = NewHandle(way, page_level, page_num, seed);
+	if (bf == nullptr) {
+		return nullptr;
+	}
+	bf->space = static_cast<uint8_t*>(space);
+	bf->unique_cnt = unique_cnt;
+	return bf;
+}
+
+void pbf_free(pbf_filter* bf) {
+	if (bf == nullptr) {
+		return;
+	}
+	if (bf->owned) {
+		free(bf->space);
+	}
+	free(bf);
+}
+
+unsigned pbf_way(const pbf_filter* bf) { return bf != nullptr ? bf->way : 0; }
+unsigned pbf_page_level(const pbf_filter* bf) { return bf != nullptr ? bf->page_level : 0; }
+unsigned pbf_page_num(const pbf_filter* bf) { return bf != nullptr ? bf->page_num : 0; }
+uint64_t pbf_seed(const pbf_filter* bf) { return bf != nullptr ? bf->seed : 0; }
+size_t pbf_unique_cnt(const pbf_filter* bf) { return bf != nullptr ? bf->unique_cnt : 0; }
+const void* pbf_data(const pbf_filter* bf) { return bf != nullptr ? bf->space : nullptr; }
+size_t pbf_data_size(const pbf_filter* bf) {
+	return bf != nullptr ? static_cast<size_t>(bf->page_num) << bf->page_level : 0;
+}
+
+void pbf_clear(pbf_filter* bf) {
+	if (bf == nullptr) {
+		return;
+	}
+	memset(bf->space, 0, pbf_data_size(bf));
+	bf->unique_cnt = 0;
+}
+
+bool pbf_fold(pbf_filter* bf, unsigned factor) {
+	if (bf == nullptr || !PBF_Fold(bf->space, bf->page_level, bf->page_num, factor)) {
+		return false;
+	}
+	bf->page_num /= factor;
+	bf->fac = UINT64_MAX / bf->page_num + 1;
+	if (bf->owned && factor > 1) {
+		auto space = static_cast<uint8_t*>(realloc(bf->space, pbf_data_size(bf)));
+		if (space != nullptr) {
+			bf->space = space;
+		}
+	}
+	return true;
+}
+
+bool pbf_set(pbf_filter* bf, const void* key, unsigned len) {
+	return SetBatch(bf, pbf::KeyList<const void*>{&key, &len}, 1, nullptr) != 0;
+}
+
+bool pbf_test(const pbf_filter* bf, const void* key, unsigned len) {
+	return BatchOf<false>(bf, pbf::KeyList<const void*>{&key, &len}, 1, nullptr) != 0;
+}
+
+size_t pbf_set_batch(pbf_filter* bf, const void* const* keys, const unsigned* lens, size_t n,
+					 uint8_t* bitmap) {
+	return SetBatch(bf, pbf::KeyList<const void*>{keys, lens}, n, bitmap);
+}
+
+void pbf_test_batch(const pbf_filter* bf, const void* const* keys, const unsigned* lens, size_t n,
+					uint8_t* bitmap) {
+	BatchOf<false>(bf, pbf::KeyList<const void*>{keys, lens}, n, bitmap);
+}
+
+size_t pbf_set_strided(pbf_filter* bf, const void* keys, unsigned len, size_t n, uint8_t* bitmap) {
+	return SetBatch(bf, pbf::KeyStrip{(const uint8_t*)keys, len}, n, bitmap);
+}
+
+void pbf_test_strided(const pbf_filter* bf, const void* keys, unsigned len, size_t n, uint8_t* bitmap) {
+	BatchOf<false>(bf, pbf::KeyStrip{(const uint8_t*)keys, len}, n, bitmap);
+}
+
+size_t pbf_set_offsets(pbf_filter* bf, const void* buf, const size_t* offsets, size_t n,
+					   uint8_t* bitmap) {
+	return SetBatch(bf, pbf::KeyOffsets{(const uint8_t*)buf, offsets}, n, bitmap);
+}
+
+void pbf_test_offsets(const pbf_filter* bf, const void* buf, const size_t* offsets, size_t n,
+					  uint8_t* bitmap) {
+	BatchOf<false>(bf, pbf::KeyOffsets{(const uint8_t*)buf, offsets}, n, bitmap);
+}
+
+}
+
+#endif // C_ALL_IN_ONE
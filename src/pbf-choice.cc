@@ -0,0 +1,145 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <cstring>
+#include <algorithm>
+#include "pbf.h"
+#include "pbf-internal.h"
+#include "hash-select.h"
+
+namespace pbf {
+
+namespace {
+
+// Second candidate page, from a multiplicative mix rather than PageHash's
+// rotations so the two indexes are independent.
+static FORCE_INLINE uint32_t AltPageHash(V128X t) noexcept {
+	uint64_t x = t.v.l ^ ((t.v.h << 32U) | (t.v.h >> 32U));
+	return static_cast<uint32_t>((x * 0x9e3779b97f4a7c15ULL) >> 32U);
+}
+
+// Like Set<N>, but returns how many bits were new.
+template <unsigned N>
+static FORCE_INLINE unsigned SetCount(uint8_t* page, unsigned page_level, V128X t) noexcept {
+	unsigned fresh = 0;
+	uint16_t mask = (1U << (page_level+3U)) - 1U;
+	for (unsigned i = 0; i < N; i++) {
+		uint16_t idx = t.s[i] & mask;
+		uint8_t bit = 1U << (idx&7);
+		fresh += (page[idx>>3U] & bit) == 0;
+		page[idx>>3U] |= bit;
+	}
+	return fresh;
+}
+
+static FORCE_INLINE uint16_t Saturate(unsigned v) noexcept {
+	return static_cast<uint16_t>(std::min(v, 0xffffU));
+}
+
+} // namespace
+
+template <unsigned N>
+TwoChoiceBloomFilter<N>::TwoChoiceBloomFilter(unsigned page_level, unsigned page_num, size_t unique_cnt,
+											  const uint8_t* data, HashId hash, uint64_t seed,
+											  MemoryResource* resource) {
+	auto func = ResolveHash(hash);
+	if (func == nullptr || page_level < (8-8/N) || page_level > 13 || page_num == 0 || page_num >= kMaxPageNum) {
+		return;
+	}
+	if (resource == nullptr) {
+		resource = DefaultMemoryResource();
+	}
+	const size_t page_size = size_t{1} << page_level;
+	const size_t size = page_num * page_size;
+	const size_t fill_size = page_num * sizeof(uint16_t);
+	std::unique_ptr<uint8_t[], detail::SpaceDeleter> space(
+			static_cast<uint8_t*>(resource->allocate(size, detail::kSpaceAlign)),
+			detail::SpaceDeleter{resource, size});
+	std::unique_ptr<uint8_t[], detail::SpaceDeleter> fill(
+			static_cast<uint8_t*>(resource->allocate(fill_size, detail::kSpaceAlign)),
+			detail::SpaceDeleter{resource, fill_size});
+	if (space == nullptr || fill == nullptr) {
+		return;
+	}
+	auto counter = reinterpret_cast<uint16_t*>(fill.get());
+	if (data == nullptr) {
+		if (!resource->zeroed()) {
+			memset(space.get(), 0, size);
+			memset(counter, 0, fill_size);
+		}
+		unique_cnt = 0;
+	} else {
+		memcpy(space.get(), data, size);
+		for (unsigned i = 0; i < page_num; i++) {
+			counter[i] = Saturate(static_cast<unsigned>(PopCount(space.get() + i * page_size, page_size)));
+		}
+	}
+	m_space = std::move(space);
+	m_fill = std::move(fill);
+	m_page_level = page_level;
+	m_page_num = page_num;
+	m_unique_cnt = unique_cnt;
+	m_hash_id = hash;
+	m_hash = func;
+	m_seed = seed;
+}
+
+template <unsigned N>
+void TwoChoiceBloomFilter<N>::clear() noexcept {
+	m_unique_cnt = 0;
+	if (m_space != nullptr) {
+		if (!m_space.get_deleter().resource->discard(m_space.get(), data_size())) {
+			memset(m_space.get(), 0, data_size());
+		}
+		memset(m_fill.get(), 0, m_page_num.value() * sizeof(uint16_t));
+	}
+}
+
+template <unsigned N>
+bool TwoChoiceBloomFilter<N>::test(const uint8_t* data, unsigned len) const noexcept {
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return false;
+	}
+	V128X t;
+	t.v = HashWith(m_hash, data, len, m_seed);
+	const uint8_t* a = m_space.get() + (static_cast<size_t>(PageHash(t) % m_page_num) << m_page_level);
+	const uint8_t* b = m_space.get() + (static_cast<size_t>(AltPageHash(t) % m_page_num) << m_page_level);
+	Prefetch<N>(a, m_page_level, t);
+	Prefetch<N>(b, m_page_level, t);
+	return Test<N>(a, m_page_level, t) || Test<N>(b, m_page_level, t);
+}
+
+template <unsigned N>
+bool TwoChoiceBloomFilter<N>::set(const uint8_t* data, unsigned len) noexcept {
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return false;
+	}
+	V128X t;
+	t.v = HashWith(m_hash, data, len, m_seed);
+	const uint32_t ia = PageHash(t) % m_page_num;
+	const uint32_t ib = AltPageHash(t) % m_page_num;
+	uint8_t* a = m_space.get() + (static_cast<size_t>(ia) << m_page_level);
+	uint8_t* b = m_space.get() + (static_cast<size_t>(ib) << m_page_level);
+	Prefetch<N>(a, m_page_level, t);
+	Prefetch<N>(b, m_page_level, t);
+	if (Test<N>(a, m_page_level, t) || Test<N>(b, m_page_level, t)) {
+		return false;
+	}
+	auto counter = fill();
+	const uint32_t pick = counter[ib] < counter[ia] ? ib : ia;
+	auto fresh = SetCount<N>(pick == ia ? a : b, m_page_level, t);
+	counter[pick] = Saturate(counter[pick] + fresh);
+	m_unique_cnt++;
+	return true;
+}
+
+template class TwoChoiceBloomFilter<4>;
+template class TwoChoiceBloomFilter<5>;
+template class TwoChoiceBloomFilter<6>;
+template class TwoChoiceBloomFilter<7>;
+template class TwoChoiceBloomFilter<8>;
+
+} //pbf
@@ -0,0 +1,653 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#include "pbf.h"
+#include "pbf-disk.h"
+#include "pbf-internal.h"
+#include "hash-select.h"
+
+namespace pbf {
+
+namespace {
+
+struct Probe {
+	V128X t;
+	uint32_t page;
+	DiskBloomFilter::Callback done;
+};
+
+struct PageRead {
+	uint32_t page;
+	std::unique_ptr<uint8_t[]> buf;
+	std::vector<Probe> probes;
+};
+
+using CompleteFunc = std::function<void(PageRead*, bool)>;
+
+static bool ReadFully(int fd, uint8_t* buf, size_t size, uint64_t off) noexcept {
+	while (size != 0) {
+		auto n = pread(fd, buf, size, static_cast<off_t>(off));
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		if (n == 0) {
+			return false;
+		}
+		buf += n;
+		off += n;
+		size -= n;
+	}
+	return true;
+}
+
+class PageReader {
+public:
+	virtual ~PageReader() = default;
+	virtual const char* name() const noexcept = 0;
+	virtual void submit(PageRead** jobs, size_t n) = 0;
+};
+
+class PreadReader final : public PageReader {
+public:
+	PreadReader(int fd, size_t page_size, uint64_t offset, unsigned threads, CompleteFunc complete)
+		: m_fd(fd), m_page_size(page_size), m_offset(offset), m_complete(std::move(complete)) {
+		threads = std::max(threads, 1U);
+		for (unsigned i = 0; i < threads; i++) {
+			m_workers.emplace_back([this]() { work(); });
+		}
+	}
+
+	~PreadReader() override {
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+		for (auto& t : m_workers) {
+			t.join();
+		}
+	}
+
+	const char* name() const noexcept override { return "pread"; }
+
+	void submit(PageRead** jobs, size_t n) override {
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_queue.insert(m_queue.end(), jobs, jobs + n);
+		}
+		m_cond.notify_all();
+	}
+
+private:
+	int m_fd;
+	size_t m_page_size;
+	uint64_t m_offset;
+	CompleteFunc m_complete;
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	std::deque<PageRead*> m_queue;
+	std::vector<std::thread> m_workers;
+	bool m_stop = false;
+
+	void work() {
+		for (;;) {
+			PageRead* job = nullptr;
+			{
+				std::unique_lock<std::mutex> guard(m_lock);
+				m_cond.wait(guard, [this]() { return m_stop || !m_queue.empty(); });
+				if (m_queue.empty()) {
+					return;
+				}
+				job = m_queue.front();
+				m_queue.pop_front();
+			}
+			bool ok = ReadFully(m_fd, job->buf.get(), m_page_size,
+								m_offset + static_cast<uint64_t>(job->page) * m_page_size);
+			m_complete(job, ok);
+		}
+	}
+};
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+
+// Minimal io_uring driver over raw syscalls, so no liburing is required.
+// One reaper thread drains completions; submitters share the SQ under a lock.
+class UringReader final : public PageReader {
+public:
+	static std::unique_ptr<PageReader> Create(int fd, size_t page_size, uint64_t offset,
+											  unsigned depth, CompleteFunc complete) {
+		std::unique_ptr<UringReader> reader(new UringReader(fd, page_size, offset, depth, std::move(complete)));
+		if (!reader->setup()) {
+			return nullptr;
+		}
+		reader->m_reaper = std::thread([ptr = reader.get()]() { ptr->reap(); });
+		return reader;
+	}
+
+	~UringReader() override {
+		if (m_reaper.joinable()) {
+			stop();
+			m_reaper.join();
+		}
+		if (m_sqes != nullptr) munmap(m_sqes, m_sqes_size);
+		if (m_cq_ring != nullptr && m_cq_ring != m_sq_ring) munmap(m_cq_ring, m_cq_ring_size);
+		if (m_sq_ring != nullptr) munmap(m_sq_ring, m_sq_ring_size);
+		if (m_ring_fd >= 0) close(m_ring_fd);
+	}
+
+	const char* name() const noexcept override { return "io_uring"; }
+
+	void submit(PageRead** jobs, size_t n) override {
+		for (size_t i = 0; i < n; i++) {
+			push(jobs[i]);
+		}
+	}
+
+private:
+	int m_fd;
+	size_t m_page_size;
+	uint64_t m_offset;
+	unsigned m_depth;
+	CompleteFunc m_complete;
+
+	int m_ring_fd = -1;
+	void* m_sq_ring = nullptr;
+	void* m_cq_ring = nullptr;
+	size_t m_sq_ring_size = 0;
+	size_t m_cq_ring_size = 0;
+	io_uring_sqe* m_sqes = nullptr;
+	size_t m_sqes_size = 0;
+	unsigned* m_sq_tail = nullptr;
+	unsigned* m_sq_mask = nullptr;
+	unsigned* m_sq_array = nullptr;
+	unsigned* m_cq_head = nullptr;
+	unsigned* m_cq_tail = nullptr;
+	unsigned* m_cq_mask = nullptr;
+	io_uring_cqe* m_cqes = nullptr;
+
+	std::mutex m_lock;
+	unsigned m_inflight = 0;
+	std::deque<PageRead*> m_backlog;
+	std::thread m_reaper;
+
+	UringReader(int fd, size_t page_size, uint64_t offset, unsigned depth, CompleteFunc complete)
+		: m_fd(fd), m_page_size(page_size), m_offset(offset),
+		  m_depth(std::max(depth, 1U)), m_complete(std::move(complete)) {}
+
+	static int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) noexcept {
+		return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+	}
+
+	bool setup() {
+		io_uring_params p = {};
+		// One spare entry for the stop marker.
+		m_ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, m_depth + 1, &p));
+		if (m_ring_fd < 0) {
+			return false;
+		}
+		m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single) {
+			m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+		}
+		auto ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+						 MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+		if (ring == MAP_FAILED) {
+			return false;
+		}
+		m_sq_ring = ring;
+		if (single) {
+			m_cq_ring = m_sq_ring;
+		} else {
+			ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+			if (ring == MAP_FAILED) {
+				return false;
+			}
+			m_cq_ring = ring;
+		}
+		m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+		ring = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+		if (ring == MAP_FAILED) {
+			return false;
+		}
+		m_sqes = static_cast<io_uring_sqe*>(ring);
+
+		auto sq = static_cast<uint8_t*>(m_sq_ring);
+		m_sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		m_sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+		m_sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+		auto cq = static_cast<uint8_t*>(m_cq_ring);
+		m_cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		m_cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+		m_cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+		return true;
+	}
+
+	// Caller holds m_lock.
+	void fill(PageRead* job) noexcept {
+		m_inflight++;
+		unsigned tail = *m_sq_tail;
+		unsigned idx = tail & *m_sq_mask;
+		auto sqe = &m_sqes[idx];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->user_data = reinterpret_cast<uintptr_t>(job);
+		if (job == nullptr) {
+			sqe->opcode = IORING_OP_NOP;
+		} else {
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = m_fd;
+			sqe->off = m_offset + static_cast<uint64_t>(job->page) * m_page_size;
+			sqe->addr = reinterpret_cast<uintptr_t>(job->buf.get());
+			sqe->len = static_cast<uint32_t>(m_page_size);
+		}
+		m_sq_array[idx] = idx;
+		__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+	}
+
+	// Caller holds m_lock. Submits the last `cnt` filled entries. Entries the
+	// kernel refuses (EAGAIN, EBUSY, ENOMEM, ...) are taken back off the ring,
+	// uncounted and appended to `failed`. With nothing left in flight the
+	// reaper would never drain the backlog, so it joins them.
+	void enter(unsigned cnt, std::vector<PageRead*>& failed) {
+		while (cnt != 0) {
+			int ret = Enter(m_ring_fd, cnt, 0, 0);
+			if (ret > 0) {
+				cnt -= std::min(cnt, static_cast<unsigned>(ret));
+			} else if (ret == 0 || errno != EINTR) {
+				break;
+			}
+		}
+		if (cnt == 0) {
+			return;
+		}
+		// The kernel consumes entries in order, so the refused ones are the newest.
+		unsigned tail = *m_sq_tail - cnt;
+		for (unsigned i = 0; i < cnt; i++) {
+			auto& sqe = m_sqes[(tail + i) & *m_sq_mask];
+			failed.push_back(reinterpret_cast<PageRead*>(static_cast<uintptr_t>(sqe.user_data)));
+		}
+		__atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+		m_inflight -= cnt;
+		if (m_inflight == 0) {
+			failed.insert(failed.end(), m_backlog.begin(), m_backlog.end());
+			m_backlog.clear();
+		}
+	}
+
+	// Reads the ring refused are done with pread on this thread, outside
+	// m_lock, so their callbacks may queue new probes.
+	void fallback(const std::vector<PageRead*>& jobs) {
+		for (auto job : jobs) {
+			if (job != nullptr) {
+				m_complete(job, ReadFully(m_fd, job->buf.get(), m_page_size,
+										  m_offset + static_cast<uint64_t>(job->page) * m_page_size));
+			}
+		}
+	}
+
+	// Never blocks: reads beyond the queue depth wait in m_backlog until the
+	// reaper frees slots, so callbacks may queue new probes safely.
+	void push(PageRead* job) {
+		std::vector<PageRead*> failed;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_inflight >= m_depth) {
+				m_backlog.push_back(job);
+				return;
+			}
+			fill(job);
+			enter(1, failed);
+		}
+		fallback(failed);
+	}
+
+	// user_data 0 stops the reaper. The marker has no pread fallback, so it is
+	// retried until the ring takes it.
+	void stop() {
+		for (;;) {
+			std::vector<PageRead*> failed;
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				fill(nullptr);
+				enter(1, failed);
+			}
+			if (failed.empty()) {
+				return;
+			}
+			fallback(failed);
+			std::this_thread::yield();
+		}
+	}
+
+	void reap() {
+		for (;;) {
+			unsigned head = *m_cq_head;
+			unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			if (head == tail) {
+				Enter(m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+				continue;
+			}
+			bool stop = false;
+			unsigned done = 0;
+			for (; head != tail; head++) {
+				auto& cqe = m_cqes[head & *m_cq_mask];
+				auto job = reinterpret_cast<PageRead*>(static_cast<uintptr_t>(cqe.user_data));
+				int res = cqe.res;
+				__atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+				done++;
+				if (job == nullptr) {
+					stop = true;
+					continue;
+				}
+				auto off = m_offset + static_cast<uint64_t>(job->page) * m_page_size;
+				bool ok = static_cast<size_t>(res) == m_page_size;
+				if (!ok && res >= 0) {
+					// Short read: finish it synchronously.
+					ok = ReadFully(m_fd, job->buf.get() + res, m_page_size - res, off + res);
+				} else if (!ok && (res == -EINTR || res == -EAGAIN || res == -EINVAL)) {
+					// Retry on this thread; -EINVAL means the kernel lacks IORING_OP_READ.
+					ok = ReadFully(m_fd, job->buf.get(), m_page_size, off);
+				}
+				m_complete(job, ok);
+			}
+			std::vector<PageRead*> failed;
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				m_inflight -= done;
+				unsigned cnt = 0;
+				while (m_inflight < m_depth && !m_backlog.empty()) {
+					fill(m_backlog.front());
+					m_backlog.pop_front();
+					cnt++;
+				}
+				enter(cnt, failed);
+			}
+			fallback(failed);
+			if (stop) {
+				return;
+			}
+		}
+	}
+};
+
+#endif
+
+class PageCache {
+public:
+	explicit PageCache(size_t capacity) : m_capacity(capacity) {}
+
+	// `visitor` runs under the cache lock and must not call back into the filter.
+	template <typename Visitor>
+	bool visit(uint32_t page, Visitor&& visitor) {
+		std::lock_guard<std::mutex> guard(m_lock);
+		auto it = m_index.find(page);
+		if (it == m_index.end()) {
+			return false;
+		}
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+		visitor(it->second->second.get());
+		return true;
+	}
+
+	void put(uint32_t page, std::unique_ptr<uint8_t[]>&& buf) {
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (m_index.find(page) != m_index.end()) {
+			return;
+		}
+		if (m_lru.size() >= m_capacity) {
+			m_index.erase(m_lru.back().first);
+			m_lru.pop_back();
+		}
+		m_lru.emplace_front(page, std::move(buf));
+		m_index.emplace(page, m_lru.begin());
+	}
+
+private:
+	using Entry = std::pair<uint32_t, std::unique_ptr<uint8_t[]>>;
+	size_t m_capacity;
+	std::mutex m_lock;
+	std::list<Entry> m_lru;
+	std::unordered_map<uint32_t, std::list<Entry>::iterator> m_index;
+};
+
+using ProbeFunc = bool (*)(const uint8_t*, unsigned, V128X) noexcept;
+
+template <unsigned N>
+static bool ProbePage(const uint8_t* page, unsigned page_level, V128X t) noexcept {
+	return Test<N>(page, page_level, t);
+}
+
+class DiskBloomFilterImp final : public DiskBloomFilter {
+public:
+	DiskBloomFilterImp(int fd, unsigned way, unsigned page_level, unsigned page_num,
+					   ProbeFunc probe, detail::HashFunc hash, const Options& options)
+		: m_fd(fd), m_way(way), m_page_level(page_level), m_page_num(page_num),
+		  m_hash_id(options.hash), m_hash(hash), m_seed(options.seed), m_probe(probe),
+		  m_batch_size(std::max<size_t>(options.batch_size, 1)) {
+		if (options.cache_pages != 0) {
+			m_cache.reset(new PageCache(options.cache_pages));
+		}
+	}
+
+	~DiskBloomFilterImp() override {
+		wait();
+		m_reader.reset();
+		close(m_fd);
+	}
+
+	void start(uint64_t offset, const Options& options) {
+		size_t page_size = size_t{1} << m_page_level;
+		CompleteFunc complete = [this](PageRead* job, bool ok) { this->complete(job, ok); };
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+		if (options.use_io_uring) {
+			m_reader = UringReader::Create(m_fd, page_size, offset, options.queue_depth, complete);
+		}
+#endif
+		if (m_reader == nullptr) {
+			m_reader.reset(new PreadReader(m_fd, page_size, offset, options.io_threads, complete));
+		}
+	}
+
+	unsigned way() const noexcept override { return m_way; }
+	unsigned page_level() const noexcept override { return m_page_level; }
+	unsigned page_num() const noexcept override { return m_page_num.value(); }
+	HashId hash_id() const noexcept override { return m_hash_id; }
+	uint64_t seed() const noexcept override { return m_seed; }
+	const char* backend() const noexcept override { return m_reader->name(); }
+	size_t io_errors() const noexcept override { return m_errors.load(std::memory_order_relaxed); }
+
+	void test(const uint8_t* data, unsigned len, Callback done) override {
+		data = CheckKey(data, len);
+		if (data == nullptr) {
+			done(false);
+			return;
+		}
+		Probe probe;
+		probe.t.v = HashWith(m_hash, data, len, m_seed);
+		probe.page = PageHash(probe.t) % m_page_num;
+		probe.done = std::move(done);
+		std::vector<Probe> batch;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_pending.push_back(std::move(probe));
+			m_outstanding++;
+			if (m_pending.size() >= m_batch_size) {
+				batch.swap(m_pending);
+			}
+		}
+		if (!batch.empty()) {
+			dispatch(batch);
+		}
+	}
+
+	void flush() override {
+		std::vector<Probe> batch;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			batch.swap(m_pending);
+		}
+		if (!batch.empty()) {
+			dispatch(batch);
+		}
+	}
+
+	void wait() override {
+		flush();
+		std::unique_lock<std::mutex> guard(m_lock);
+		m_idle.wait(guard, [this]() { return m_outstanding == 0; });
+	}
+
+private:
+	int m_fd;
+	unsigned m_way;
+	unsigned m_page_level;
+	Divisor<uint32_t> m_page_num;
+	HashId m_hash_id;
+	detail::HashFunc m_hash;
+	uint64_t m_seed;
+	ProbeFunc m_probe;
+	size_t m_batch_size;
+	std::unique_ptr<PageCache> m_cache;
+	std::unique_ptr<PageReader> m_reader;
+	std::atomic<size_t> m_errors{0};
+
+	std::mutex m_lock;
+	std::condition_variable m_idle;
+	std::vector<Probe> m_pending;
+	size_t m_outstanding = 0;
+
+	void finish(size_t n) {
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_outstanding -= n;
+		if (m_outstanding == 0) {
+			m_idle.notify_all();
+		}
+	}
+
+	// Group probes by page so that each page is read at most once per batch.
+	void dispatch(std::vector<Probe>& batch) {
+		std::sort(batch.begin(), batch.end(),
+				  [](const Probe& a, const Probe& b) { return a.page < b.page; });
+		std::vector<PageRead*> jobs;
+		std::vector<uint8_t> hits;
+		for (size_t i = 0, j = 0; i < batch.size(); i = j) {
+			auto page = batch[i].page;
+			for (j = i + 1; j < batch.size() && batch[j].page == page; j++) {}
+			if (m_cache != nullptr) {
+				hits.resize(j - i);
+				bool cached = m_cache->visit(page, [&](const uint8_t* data) {
+					for (size_t k = i; k < j; k++) {
+						hits[k-i] = m_probe(data, m_page_level, batch[k].t);
+					}
+				});
+				if (cached) {
+					for (size_t k = i; k < j; k++) {
+						batch[k].done(hits[k-i] != 0);
+					}
+					finish(j - i);
+					continue;
+				}
+			}
+			auto job = new PageRead;
+			job->page = page;
+			job->buf.reset(new uint8_t[size_t{1} << m_page_level]);
+			job->probes.reserve(j - i);
+			std::move(batch.begin() + i, batch.begin() + j, std::back_inserter(job->probes));
+			jobs.push_back(job);
+		}
+		if (!jobs.empty()) {
+			m_reader->submit(jobs.data(), jobs.size());
+		}
+	}
+
+	void complete(PageRead* job, bool ok) {
+		std::unique_ptr<PageRead> holder(job);
+		if (!ok) {
+			m_errors.fetch_add(1, std::memory_order_relaxed);
+		}
+		for (auto& probe : job->probes) {
+			probe.done(!ok || m_probe(job->buf.get(), m_page_level, probe.t));
+		}
+		if (ok && m_cache != nullptr) {
+			m_cache->put(job->page, std::move(job->buf));
+		}
+		finish(job->probes.size());
+	}
+};
+
+} // namespace
+
+bool DiskBloomFilter::test(const uint8_t* data, unsigned len) {
+	std::mutex lock;
+	std::condition_variable cond;
+	bool done = false;
+	bool hit = false;
+	test(data, len, [&](bool result) {
+		std::lock_guard<std::mutex> guard(lock);
+		hit = result;
+		done = true;
+		cond.notify_one();
+	});
+	flush();
+	std::unique_lock<std::mutex> guard(lock);
+	cond.wait(guard, [&done]() { return done; });
+	return hit;
+}
+
+std::unique_ptr<DiskBloomFilter> OpenDiskBloomFilter(const char* path, unsigned way, unsigned page_level,
+		unsigned page_num, uint64_t offset, const DiskBloomFilter::Options& options) {
+	ProbeFunc probe = nullptr;
+	switch (way) {
+		case 4: probe = ProbePage<4>; break;
+		case 5: probe = ProbePage<5>; break;
+		case 6: probe = ProbePage<6>; break;
+		case 7: probe = ProbePage<7>; break;
+		case 8: probe = ProbePage<8>; break;
+		default: return nullptr;
+	}
+	auto hash = ResolveHash(options.hash);
+	if (path == nullptr || hash == nullptr || page_level < (8-8/way) || page_level > 13
+		|| page_num == 0 || page_num >= kMaxPageNum) {
+		return nullptr;
+	}
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return nullptr;
+	}
+	struct stat st;
+	uint64_t need = offset + (static_cast<uint64_t>(page_num) << page_level);
+	if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < need) {
+		close(fd);
+		return nullptr;
+	}
+	std::unique_ptr<DiskBloomFilterImp> bf(new DiskBloomFilterImp(fd, way, page_level, page_num, probe, hash, options));
+	bf->start(offset, options);
+	return bf;
+}
+
+} //pbf
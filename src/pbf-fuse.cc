@@ -0,0 +1,284 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "pbf.h"
+#include "pbf-internal.h"
+#include "hash-select.h"
+
+namespace pbf {
+
+namespace {
+
+// Construction follows the reference binary_fuse8 builder by Graf and Lemire,
+// with 3-wise hashing.
+constexpr unsigned kMaxIterations = 100;
+constexpr size_t kMaxKeys = size_t{1} << 31U;
+constexpr size_t kKeysPerThread = size_t{1} << 16U;
+
+static FORCE_INLINE uint64_t Murmur64(uint64_t h) noexcept {
+	h ^= h >> 33U;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33U;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33U;
+	return h;
+}
+
+static FORCE_INLINE uint64_t SplitMix64(uint64_t& state) noexcept {
+	uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27U)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31U);
+}
+
+struct Slots {
+	uint32_t h[5];	// h[3] and h[4] repeat h[0] and h[1] for rotation
+	Slots(uint64_t hash, uint32_t segment_length, uint32_t segment_count_length) noexcept {
+		const uint32_t mask = segment_length - 1;
+		h[0] = static_cast<uint32_t>(detail::MultiplyHigh<uint64_t>::get(hash, segment_count_length));
+		h[1] = (h[0] + segment_length) ^ (static_cast<uint32_t>(hash >> 18U) & mask);
+		h[2] = (h[0] + 2 * segment_length) ^ (static_cast<uint32_t>(hash) & mask);
+		h[3] = h[0];
+		h[4] = h[1];
+	}
+};
+
+template <typename Fingerprint>
+static FORCE_INLINE Fingerprint FingerprintOf(uint64_t hash) noexcept {
+	return static_cast<Fingerprint>(hash ^ (hash >> 32U));
+}
+
+// 64-bit key hashes, computed in parallel. False on an invalid key.
+template <typename KeyAt>
+static bool HashKeys(detail::HashFunc hash, uint64_t seed, KeyAt key_at, size_t n, unsigned threads,
+					 std::vector<uint64_t>& out) {
+	out.resize(n);
+	if (threads == 0) {
+		threads = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+	threads = static_cast<unsigned>(std::min<size_t>(threads, (n + kKeysPerThread - 1) / kKeysPerThread));
+	threads = std::max(threads, 1U);
+	std::atomic<bool> bad(false);
+	auto work = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			unsigned len;
+			auto data = key_at(i, len);
+			data = CheckKey(data, len);
+			if (data == nullptr) {
+				bad = true;
+				return;
+			}
+			out[i] = HashWith(hash, data, len, seed).l;
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < threads; t++) {
+		workers.emplace_back(work, n * t / threads, n * (t + 1) / threads);
+	}
+	work(0, n / threads);
+	for (auto& w : workers) {
+		w.join();
+	}
+	return !bad;
+}
+
+} // namespace
+
+template <typename Fingerprint>
+BinaryFuseFilter<Fingerprint>::BinaryFuseFilter(const uint8_t* const* keys, const unsigned* lens, size_t n,
+												unsigned threads, HashId hash, uint64_t seed) {
+	auto func = ResolveHash(hash);
+	std::vector<uint64_t> hashes;
+	if (func == nullptr || n > kMaxKeys || !HashKeys(func, seed, KeyList<>{keys, lens}, n, threads, hashes)) {
+		return;
+	}
+	m_hash_id = hash;
+	m_hash = func;
+	m_seed = seed;
+	populate(hashes);
+}
+
+template <typename Fingerprint>
+BinaryFuseFilter<Fingerprint>::BinaryFuseFilter(const uint8_t* keys, unsigned len, size_t n,
+												unsigned threads, HashId hash, uint64_t seed) {
+	auto func = ResolveHash(hash);
+	std::vector<uint64_t> hashes;
+	if (func == nullptr || n > kMaxKeys || !HashKeys(func, seed, KeyStrip{keys, len}, n, threads, hashes)) {
+		return;
+	}
+	m_hash_id = hash;
+	m_hash = func;
+	m_seed = seed;
+	populate(hashes);
+}
+
+template <typename Fingerprint>
+bool BinaryFuseFilter<Fingerprint>::populate(std::vector<uint64_t>& keys) {
+	size_t size = keys.size();
+	constexpr unsigned kArity = 3;
+
+	// Segment length and slack tuned for 3-wise hashing by the paper.
+	uint32_t segment_length = 4;
+	if (size > 0) {
+		auto bits = static_cast<int>(std::floor(std::log(static_cast<double>(size)) / std::log(3.33) + 2.25));
+		segment_length = 1U << std::min(std::max(bits, 2), 18);
+	}
+	size_t capacity = 0;
+	if (size > 1) {
+		auto factor = std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) / std::log(static_cast<double>(size)));
+		capacity = static_cast<size_t>(std::llround(static_cast<double>(size) * factor));
+	}
+	size_t segment_count = (capacity + segment_length - 1) / segment_length;
+	segment_count = segment_count <= kArity - 1 ? 1 : segment_count - (kArity - 1);
+	m_segment_length = segment_length;
+	m_segment_count_length = static_cast<uint32_t>(segment_count * segment_length);
+	m_array_length = static_cast<uint32_t>((segment_count + kArity - 1) * segment_length);
+	const uint32_t array_length = m_array_length;
+
+	std::vector<uint64_t> order(size + 1);	// hashes by segment, then the peeling stack
+	std::vector<uint8_t> order_slot(size);	// which of the 3 slots each stacked key owns
+	std::vector<uint32_t> alone(array_length);
+	std::vector<uint8_t> count(array_length);	// keys << 2 | xor of slot indices
+	std::vector<uint64_t> xor_hash(array_length);
+	unsigned block_bits = 1;
+	while ((size_t{1} << block_bits) < segment_count) {
+		block_bits++;
+	}
+	const uint32_t block = 1U << block_bits;
+	std::vector<size_t> start(block);
+
+	uint64_t rng = 0x726b2b9d438b9d4dULL;
+	size_t stack_size = 0;
+	bool deduplicated = false;
+	for (unsigned loop = 0; ; loop++) {
+		if (loop >= kMaxIterations) {
+			return false;
+		}
+		m_fuse_seed = SplitMix64(rng);
+		std::fill(order.begin(), order.begin() + size, 0);
+		order[size] = 1;	// sentinel for the bucket scan
+		std::fill(count.begin(), count.end(), 0);
+		std::fill(xor_hash.begin(), xor_hash.end(), 0);
+
+		// Bucket hashes by their first segment so the counting pass walks
+		// the slot arrays roughly in order.
+		for (uint32_t i = 0; i < block; i++) {
+			start[i] = (static_cast<uint64_t>(i) * size) >> block_bits;
+		}
+		for (size_t i = 0; i < size; i++) {
+			uint64_t hash = Murmur64(keys[i] + m_fuse_seed);
+			auto seg = static_cast<uint32_t>(hash >> (64U - block_bits));
+			while (order[start[seg]] != 0) {
+				seg = (seg + 1) & (block - 1);
+			}
+			order[start[seg]++] = hash;
+		}
+
+		bool error = false;
+		size_t duplicates = 0;
+		for (size_t i = 0; i < size; i++) {
+			uint64_t hash = order[i];
+			Slots s(hash, m_segment_length, m_segment_count_length);
+			for (unsigned k = 0; k < kArity; k++) {
+				count[s.h[k]] += 4;
+				count[s.h[k]] ^= k;
+				xor_hash[s.h[k]] ^= hash;
+			}
+			// A repeated key cancels its twin, leaving a zero hash with two keys.
+			if ((xor_hash[s.h[0]] & xor_hash[s.h[1]] & xor_hash[s.h[2]]) == 0
+				&& ((xor_hash[s.h[0]] == 0 && count[s.h[0]] == 8)
+					|| (xor_hash[s.h[1]] == 0 && count[s.h[1]] == 8)
+					|| (xor_hash[s.h[2]] == 0 && count[s.h[2]] == 8))) {
+				duplicates++;
+				for (unsigned k = 0; k < kArity; k++) {
+					count[s.h[k]] -= 4;
+					count[s.h[k]] ^= k;
+					xor_hash[s.h[k]] ^= hash;
+				}
+			}
+			// The 6-bit key count wrapped.
+			error |= count[s.h[0]] < 4 || count[s.h[1]] < 4 || count[s.h[2]] < 4;
+		}
+		if (error) {
+			continue;
+		}
+
+		// Peel slots holding a single key until none are left.
+		size_t queue = 0;
+		for (uint32_t i = 0; i < array_length; i++) {
+			alone[queue] = i;
+			queue += (count[i] >> 2U) == 1;
+		}
+		stack_size = 0;
+		while (queue > 0) {
+			uint32_t index = alone[--queue];
+			if ((count[index] >> 2U) != 1) {
+				continue;
+			}
+			uint64_t hash = xor_hash[index];
+			Slots s(hash, m_segment_length, m_segment_count_length);
+			uint8_t found = count[index] & 3U;
+			order_slot[stack_size] = found;
+			order[stack_size] = hash;
+			stack_size++;
+			for (unsigned k = 1; k < kArity; k++) {
+				uint32_t other = s.h[found + k];
+				alone[queue] = other;
+				queue += (count[other] >> 2U) == 2;
+				count[other] -= 4;
+				count[other] ^= (found + k) % kArity;
+				xor_hash[other] ^= hash;
+			}
+		}
+		if (stack_size + duplicates == size) {
+			break;
+		}
+		// Inline detection misses repeats sharing slots with other keys, and
+		// those block peeling. Drop them once before the next attempt.
+		if (!deduplicated) {
+			std::sort(keys.begin(), keys.end());
+			keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+			size = keys.size();
+			deduplicated = true;
+		}
+	}
+
+	// Assign in reverse peeling order: each key's own slot is still free.
+	std::unique_ptr<Fingerprint[]> slots(new Fingerprint[array_length]());
+	for (size_t i = stack_size; i-- > 0;) {
+		uint64_t hash = order[i];
+		Slots s(hash, m_segment_length, m_segment_count_length);
+		unsigned found = order_slot[i];
+		slots[s.h[found]] = static_cast<Fingerprint>(FingerprintOf<Fingerprint>(hash)
+				^ slots[s.h[found + 1]] ^ slots[s.h[found + 2]]);
+	}
+	m_unique_cnt = stack_size;
+	m_slots = std::move(slots);
+	return true;
+}
+
+template <typename Fingerprint>
+bool BinaryFuseFilter<Fingerprint>::test(const uint8_t* data, unsigned len) const noexcept {
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return false;
+	}
+	if (m_slots == nullptr) {
+		return false;
+	}
+	uint64_t hash = Murmur64(HashWith(m_hash, data, len, m_seed).l + m_fuse_seed);
+	Slots s(hash, m_segment_length, m_segment_count_length);
+	auto f = FingerprintOf<Fingerprint>(hash);
+	return static_cast<Fingerprint>(f ^ m_slots[s.h[0]] ^ m_slots[s.h[1]] ^ m_slots[s.h[2]]) == 0;
+}
+
+template class BinaryFuseFilter<uint8_t>;
+template class BinaryFuseFilter<uint16_t>;
+
+} //pbf
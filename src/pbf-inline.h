@@ -0,0 +1,102 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+#ifndef PAGE_BLOOM_FILTER_INLINE_H
+#define PAGE_BLOOM_FILTER_INLINE_H
+
+// Single-key probe path of PageBloomFilter<N> and FixedPageBloomFilter. The
+// library instantiates it in pbf.cc; with PBF_HEADER_ONLY, pbf.h includes it
+// too and callers inline it, hash included, so a constant key length folds
+// into the hash. Both builds compile the same code and so produce identical
+// bitmaps.
+
+#include "pbf.h"
+#include "pbf-internal.h"
+#include "hash-default.h"
+#include "hash-select.h"
+#include "pbf-stats.h"
+
+#ifdef PBF_HEADER_ONLY
+#define PBF_INLINE_PROBE FORCE_INLINE
+#else
+#define PBF_INLINE_PROBE
+#endif
+
+namespace pbf {
+
+// The build's own hash is called directly so it can inline; other hashes go
+// through the pointer resolved at construction.
+static FORCE_INLINE V128 FilterHash(HashId id, detail::HashFunc func, const uint8_t* data, unsigned len,
+									uint64_t seed) noexcept {
+	if (static_cast<unsigned>(id) == kBuildHashId) {
+		return BuildHash(data, len, seed);
+	}
+	return HashWith(func, data, len, seed);
+}
+
+template <unsigned N>
+PBF_INLINE_PROBE bool PageBloomFilter<N>::test(const uint8_t* data, unsigned len) const noexcept {
+	OpProbe probe;
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return probe.test(false);
+	}
+	V128X t;
+	t.v = FilterHash(m_hash_id, m_hash, data, len, m_seed);
+	size_t idx = PageHash(t) % m_page_num;
+	const uint8_t* page = m_space.get() + (idx << m_page_level);
+	return probe.test(Test<N>(page, m_page_level, t));
+}
+
+template <unsigned N>
+PBF_INLINE_PROBE bool PageBloomFilter<N>::set(const uint8_t* data, unsigned len) noexcept {
+	OpProbe probe;
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return probe.set(false);
+	}
+	V128X t;
+	t.v = FilterHash(m_hash_id, m_hash, data, len, m_seed);
+	size_t idx = PageHash(t) % m_page_num;
+	uint8_t* page = m_space.get() + (idx << m_page_level);
+	if (probe.set(Set<N>(page, m_page_level, t))) {
+		m_unique_cnt++;
+		return true;
+	}
+	return false;
+}
+
+template <unsigned N, unsigned PageLevel>
+PBF_INLINE_PROBE bool detail::FixedProbe<N, PageLevel>::hash(const uint8_t* data, unsigned len, uint64_t seed,
+															  FixedKey& key) noexcept {
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return false;
+	}
+	V128X t;
+	t.v = BuildHash(data, len, seed);
+	key.code = {t.v.l, t.v.h};
+	key.page_hash = PageHash(t);
+	return true;
+}
+
+template <unsigned N, unsigned PageLevel>
+PBF_INLINE_PROBE bool detail::FixedProbe<N, PageLevel>::test(const uint8_t* page, const FixedKey& key) noexcept {
+	V128X t;
+	t.v = {key.code.l, key.code.h};
+	return Test<N>(page, PageLevel, t);
+}
+
+template <unsigned N, unsigned PageLevel>
+PBF_INLINE_PROBE bool detail::FixedProbe<N, PageLevel>::set(uint8_t* page, const FixedKey& key) noexcept {
+	V128X t;
+	t.v = {key.code.l, key.code.h};
+	return Set<N>(page, PageLevel, t);
+}
+
+} //pbf
+
+#undef PBF_INLINE_PROBE
+#endif // PAGE_BLOOM_FILTER_INLINE_H
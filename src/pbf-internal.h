@@ -2,10 +2,18 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#pragma once
+#ifndef PAGE_BLOOM_FILTER_INTERNAL_H
+#define PAGE_BLOOM_FILTER_INTERNAL_H
+
 #include "platform.h"
 
 #if defined(PBF_ARCH_X86_64) && !defined(DISABLE_SIMD_OPTIMIZE)
 #include <immintrin.h>
+#elif defined(_MSC_VER) && defined(PBF_ARCH_X86_64)
+#include <xmmintrin.h>
+#elif defined(__wasm_simd128__) && !defined(DISABLE_SIMD_OPTIMIZE)
+#include <wasm_simd128.h>
 #endif
 #include "hash.h"
 
@@ -17,6 +25,8 @@ union V128X {
 	uint16_t s[8];
 #if defined(PBF_ARCH_X86_64) && !defined(DISABLE_SIMD_OPTIMIZE)
 	__m128i m;
+#elif defined(__wasm_simd128__) && !defined(DISABLE_SIMD_OPTIMIZE)
+	v128_t x;
 #endif
 };
 
@@ -30,6 +40,100 @@ static FORCE_INLINE uint32_t PageHash(V128X t) noexcept {
 	return Rot32(t.w[0], 8) ^ Rot32(t.w[1], 6) ^ Rot32(t.w[2], 4) ^ Rot32(t.w[3], 2);
 }
 
+static FORCE_INLINE unsigned PopCount64(uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+	return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+	x = x - ((x >> 1U) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2U) & 0x3333333333333333ULL);
+	x = (x + (x >> 4U)) & 0x0f0f0f0f0f0f0f0fULL;
+	return static_cast<unsigned>((x * 0x0101010101010101ULL) >> 56U);
+#endif
+}
+
+// Set bits in a page; `size` is a multiple of 64.
+static inline size_t PopCount(const uint8_t* data, size_t size) noexcept {
+	size_t cnt = 0;
+#if defined(__AVX2__) && !defined(DISABLE_SIMD_OPTIMIZE)
+	// Nibble lookup with vpshufb, summed by vpsadbw (Mula et al.).
+	const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+										 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i acc = _mm256_setzero_si256();
+	for (size_t i = 0; i < size; i += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		__m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)),
+									_mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+	}
+	cnt = static_cast<size_t>(_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1)
+							  + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3));
+#else
+	for (size_t i = 0; i < size; i += 8) {
+		cnt += PopCount64(*reinterpret_cast<const uint64_t*>(data + i));
+	}
+#endif
+	return cnt;
+}
+
+// dst |= src over `size` bytes, a multiple of 64.
+static inline void OrBytes(uint8_t* dst, const uint8_t* src, size_t size) noexcept {
+#if defined(__AVX2__) && !defined(DISABLE_SIMD_OPTIMIZE)
+	for (size_t i = 0; i < size; i += 32) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(a, b));
+	}
+#elif defined(PBF_ARCH_X86_64) && !defined(DISABLE_SIMD_OPTIMIZE)
+	for (size_t i = 0; i < size; i += 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(a, b));
+	}
+#elif defined(__wasm_simd128__) && !defined(DISABLE_SIMD_OPTIMIZE)
+	for (size_t i = 0; i < size; i += 16) {
+		wasm_v128_store(dst + i, wasm_v128_or(wasm_v128_load(dst + i), wasm_v128_load(src + i)));
+	}
+#else
+	for (size_t i = 0; i < size; i += 8) {
+		*reinterpret_cast<uint64_t*>(dst + i) |= *reinterpret_cast<const uint64_t*>(src + i);
+	}
+#endif
+}
+
+// Since h % (m*f) % m == h % m, pages i, i+m, ..., i+(f-1)*m of a filter with
+// m*f pages OR into page i of a valid filter with m pages built from the same
+// keys. In-page bit positions do not depend on the page count. The blocks of
+// m pages are contiguous, so this ORs blocks 1..f-1 into block 0.
+static inline void FoldPages(uint8_t* space, size_t block_size, unsigned factor) noexcept {
+	for (unsigned k = 1; k < factor; k++) {
+		OrBytes(space, space + k * block_size, block_size);
+	}
+}
+
+static FORCE_INLINE void Prefetch(const void* addr) noexcept {
+#if defined(_MSC_VER) && defined(PBF_ARCH_X86_64)
+	_mm_prefetch(reinterpret_cast<const char*>(addr), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(addr);
+#else
+	(void)addr;
+#endif
+}
+
+// Touch every cache line a probe will read, not just the page head.
+template <unsigned N>
+static FORCE_INLINE void Prefetch(const uint8_t* page, unsigned page_level, V128X t) noexcept {
+	if (page_level <= 6) {
+		Prefetch(page);
+		return;
+	}
+	uint16_t mask = (1U << (page_level+3U)) - 1U;
+	for (unsigned i = 0; i < N; i++) {
+		Prefetch(page + ((t.s[i] & mask) >> 3U));
+	}
+}
+
 template <unsigned N>
 static FORCE_INLINE bool Test(const uint8_t* page, unsigned page_level, V128X t) noexcept {
 #if defined(__AVX2__) && !defined(DISABLE_SIMD_OPTIMIZE)
@@ -49,6 +153,25 @@ static FORCE_INLINE bool Test(const uint8_t* page, unsigned page_level, V128X t)
 		__m256i bit = _mm256_sllv_epi32(_mm256_set1_epi32(1), _mm256_and_si256(idx, _mm256_set1_epi32(31)));
 		return _mm256_testz_si256(_mm256_andnot_si256(rec, bit), bit);
 	}
+#elif defined(__wasm_simd128__) && !defined(DISABLE_SIMD_OPTIMIZE)
+	// SIMD128 has no gather and no per-lane variable shift: offsets come from
+	// vector math, bytes from scalar loads, 1<<(idx&7) from a byte shuffle
+	// (selector 16+ yields 0 in the high byte of each lane), and all probes
+	// are checked at once. Unused lanes load 0xff and always pass.
+	const v128_t idx = wasm_v128_and(t.x, wasm_i16x8_splat((int16_t)((1U << (page_level+3U)) - 1U)));
+	const v128_t off = wasm_u16x8_shr(idx, 3);
+	const v128_t bit = wasm_i8x16_swizzle(wasm_u8x16_make(1, 2, 4, 8, 16, 32, 64, 128, 0, 0, 0, 0, 0, 0, 0, 0),
+			wasm_v128_or(wasm_v128_and(idx, wasm_i16x8_splat(7)), wasm_i16x8_splat(0x1000)));
+	v128_t rec = wasm_i16x8_splat(0xff);
+	rec = wasm_u16x8_replace_lane(rec, 0, page[wasm_u16x8_extract_lane(off, 0)]);
+	rec = wasm_u16x8_replace_lane(rec, 1, page[wasm_u16x8_extract_lane(off, 1)]);
+	rec = wasm_u16x8_replace_lane(rec, 2, page[wasm_u16x8_extract_lane(off, 2)]);
+	rec = wasm_u16x8_replace_lane(rec, 3, page[wasm_u16x8_extract_lane(off, 3)]);
+	if (N > 4) rec = wasm_u16x8_replace_lane(rec, 4, page[wasm_u16x8_extract_lane(off, 4)]);
+	if (N > 5) rec = wasm_u16x8_replace_lane(rec, 5, page[wasm_u16x8_extract_lane(off, 5)]);
+	if (N > 6) rec = wasm_u16x8_replace_lane(rec, 6, page[wasm_u16x8_extract_lane(off, 6)]);
+	if (N > 7) rec = wasm_u16x8_replace_lane(rec, 7, page[wasm_u16x8_extract_lane(off, 7)]);
+	return wasm_i16x8_all_true(wasm_i16x8_eq(wasm_v128_and(rec, bit), bit));
 #endif
 	uint16_t mask = (1U << (page_level+3U)) - 1U;
 	for (unsigned i = 0; i < N; i++) {
@@ -74,4 +197,125 @@ static FORCE_INLINE bool Set(uint8_t* page, unsigned page_level, V128X t) noexce
 	return !hit;
 }
 
+// A null key of length 0 is the empty key; with any other length it is
+// rejected, and nullptr is returned.
+static FORCE_INLINE const uint8_t* CheckKey(const uint8_t* data, unsigned len) noexcept {
+	static const uint8_t empty_key = 0;
+	if (data == nullptr) {
+		return len == 0 ? &empty_key : nullptr;
+	}
+	return data;
+}
+
+// Key sources of the batch calls: key_at(i, len) returns key i and its length.
+template <typename Ptr=const uint8_t*>
+struct KeyList {
+	const Ptr* keys;
+	const unsigned* lens;
+	const uint8_t* operator()(size_t i, unsigned& len) const noexcept {
+		len = lens[i];
+		return static_cast<const uint8_t*>(keys[i]);
+	}
+};
+
+struct KeyStrip {
+	const uint8_t* keys;
+	unsigned len;
+	const uint8_t* operator()(size_t i, unsigned& out) const noexcept {
+		out = len;
+		return keys + i * len;
+	}
+};
+
+struct KeyOffsets {
+	const uint8_t* buf;
+	const size_t* offsets;
+	const uint8_t* operator()(size_t i, unsigned& len) const noexcept {
+		len = static_cast<unsigned>(offsets[i+1] - offsets[i]);
+		return buf + offsets[i];
+	}
+};
+
+// Hashes keys [i, i+m) into t with hash(data, len), clearing valid[j] for
+// rejected keys.
+template <typename KeyAt, typename HashOp>
+static FORCE_INLINE void HashEach(const KeyAt& key_at, size_t i, size_t m, const HashOp& hash,
+								  V128X* t, bool* valid) noexcept {
+	for (size_t j = 0; j < m; j++) {
+		unsigned len;
+		auto data = key_at(i+j, len);
+		data = CheckKey(data, len);
+		valid[j] = data != nullptr;
+		if (data != nullptr) {
+			t[j].v = hash(data, len);
+		}
+	}
+}
+
+template <unsigned N, bool Insert>
+struct PageOp {
+	using Page = const uint8_t*;
+	static FORCE_INLINE bool run(Page page, unsigned page_level, V128X t) noexcept {
+		return Test<N>(page, page_level, t);
+	}
+};
+
+template <unsigned N>
+struct PageOp<N, true> {
+	using Page = uint8_t*;
+	static FORCE_INLINE bool run(Page page, unsigned page_level, V128X t) noexcept {
+		return Set<N>(page, page_level, t);
+	}
+};
+
+constexpr size_t kBatchWindow = 16;
+
+// Batch test or set, a window of keys at a time. hash_window(i, m, t, valid)
+// hashes keys [i, i+m), locate(i, t) returns the page of key i or nullptr to
+// skip it, and every located page is prefetched before any is probed, so the
+// cache misses overlap. emit(i, m, bits) gets the window's hits, bit j for key
+// i+j. Returns the number of hits, which for Insert means new keys.
+template <unsigned N, bool Insert, typename HashWindow, typename Locate, typename Emit>
+static FORCE_INLINE size_t ProbeBatch(size_t n, unsigned page_level, const HashWindow& hash_window,
+									  const Locate& locate, const Emit& emit) noexcept {
+	V128X t[kBatchWindow];
+	bool valid[kBatchWindow];
+	typename PageOp<N, Insert>::Page pages[kBatchWindow];
+	size_t cnt = 0;
+	for (size_t i = 0; i < n; i += kBatchWindow) {
+		size_t m = n - i < kBatchWindow ? n - i : kBatchWindow;
+		hash_window(i, m, t, valid);
+		for (size_t j = 0; j < m; j++) {
+			pages[j] = valid[j] ? locate(i+j, t[j]) : nullptr;
+			if (pages[j] != nullptr) {
+				Prefetch<N>(pages[j], page_level, t[j]);
+			}
+		}
+		uint32_t bits = 0;
+		for (size_t j = 0; j < m; j++) {
+			bool hit = pages[j] != nullptr && PageOp<N, Insert>::run(pages[j], page_level, t[j]);
+			bits |= static_cast<uint32_t>(hit) << j;
+			cnt += hit;
+		}
+		emit(i, m, bits);
+	}
+	return cnt;
+}
+
+// emit for batch tests that report one bool per key.
+struct EmitBools {
+	bool* out;
+	FORCE_INLINE void operator()(size_t i, size_t m, uint32_t bits) const noexcept {
+		for (size_t j = 0; j < m; j++) {
+			out[i+j] = (bits >> j) & 1U;
+		}
+	}
+};
+
+// emit for batch sets, which only count.
+struct EmitNothing {
+	FORCE_INLINE void operator()(size_t, size_t, uint32_t) const noexcept {}
+};
+
 } //pbf
+#endif // PAGE_BLOOM_FILTER_INTERNAL_H
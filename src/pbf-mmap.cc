@@ -0,0 +1,68 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstring>
+#include "pbf.h"
+
+namespace pbf {
+
+namespace {
+
+#if defined(MAP_NORESERVE)
+constexpr int kMapFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#else
+constexpr int kMapFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+#endif
+
+} // namespace
+
+MappedMemoryResource::MappedMemoryResource(size_t discard_threshold) noexcept
+	: m_page_size(static_cast<size_t>(sysconf(_SC_PAGESIZE))), m_discard_threshold(discard_threshold) {}
+
+void* MappedMemoryResource::allocate(size_t size, size_t align) noexcept {
+	if (size == 0 || align > m_page_size) {
+		return nullptr;
+	}
+	void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, kMapFlags, -1, 0);
+	return addr != MAP_FAILED ? addr : nullptr;
+}
+
+void MappedMemoryResource::deallocate(void* p, size_t size, size_t) noexcept {
+	if (p != nullptr) {
+		munmap(p, size);
+	}
+}
+
+bool MappedMemoryResource::discard(void* p, size_t size) noexcept {
+	if (size < m_discard_threshold) {
+		return false;
+	}
+	// Only whole pages can be dropped; the partial pages at either end are zeroed in place.
+	auto begin = reinterpret_cast<uintptr_t>(p);
+	auto end = begin + size;
+	auto first = (begin + m_page_size - 1) & ~(m_page_size - 1);
+	auto last = end & ~(m_page_size - 1);
+	if (first >= last) {
+		return false;
+	}
+	auto addr = reinterpret_cast<void*>(first);
+#if defined(__linux__)
+	// Private anonymous pages read back as zero after MADV_DONTNEED.
+	if (madvise(addr, last - first, MADV_DONTNEED) != 0) {
+		return false;
+	}
+#else
+	// Elsewhere MADV_DONTNEED is only a hint, so map fresh zero pages over the range.
+	if (mmap(addr, last - first, PROT_READ | PROT_WRITE, kMapFlags | MAP_FIXED, -1, 0) == MAP_FAILED) {
+		return false;
+	}
+#endif
+	memset(p, 0, first - begin);
+	memset(reinterpret_cast<void*>(last), 0, end - last);
+	return true;
+}
+
+} //pbf
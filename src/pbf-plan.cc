@@ -0,0 +1,153 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "pbf.h"
+
+namespace pbf {
+
+namespace {
+
+// Items land on pages as Poisson(item/page_num); a page holding k items has
+// fill 1-(1-1/b)^(way*k). Summing over the load distribution captures the
+// FPR lost to uneven pages, which the closed-form estimate ignores.
+static double PredictFpr(size_t item, unsigned way, unsigned page_level, unsigned page_num) noexcept {
+	const double bits = std::ldexp(1.0, static_cast<int>(page_level) + 3);
+	const double lambda = static_cast<double>(item) / page_num;
+	const double log_keep = std::log1p(-1.0 / bits) * way;
+	const double spread = 10 * std::sqrt(lambda) + 10;
+	auto lo = static_cast<size_t>(std::max(0.0, lambda - spread));
+	auto hi = static_cast<size_t>(lambda + spread);
+	const double log_lambda = std::log(lambda);
+	double fpr = 0;
+	for (size_t k = lo; k <= hi; k++) {
+		double p = std::exp(k * log_lambda - lambda - std::lgamma(k + 1.0));
+		fpr += p * std::pow(-std::expm1(log_keep * k), way);
+	}
+	return std::min(fpr, 1.0);
+}
+
+// Relative latency model in ns. Good enough to rank candidates, not to
+// predict absolute numbers on a specific host.
+static double ProbeCost(const PlanRequest& req, unsigned way, unsigned page_level, size_t size) noexcept {
+	double hash = 5.0 + 0.5 * way;
+	double latency = 80.0;
+	if (size <= req.l2_size) {
+		latency = 4.0;
+	} else if (size <= req.llc_size) {
+		latency = 15.0;
+	}
+	// Expected distinct cache lines among `way` random picks in a page;
+	// after the first miss the rest overlap through memory-level parallelism.
+	double lines = std::ldexp(1.0, std::max(static_cast<int>(page_level) - 6, 0));
+	double touched = lines * -std::expm1(way * std::log1p(-1.0 / lines));
+	double cost = hash + latency * (1.0 + 0.15 * (touched - 1.0));
+	if (latency > 15.0 && page_level > 12) {
+		cost += latency * 0.5;	// an 8KB page spans two 4KB TLB entries
+	}
+	return cost;
+}
+
+static size_t TierLimit(const PlanRequest& req) noexcept {
+	switch (req.tier) {
+		case CacheTier::kL2: return req.l2_size;
+		case CacheTier::kLLC: return req.llc_size;
+		default: return SIZE_MAX;
+	}
+}
+
+} // namespace
+
+Plan PlanFilter(const PlanRequest& req) {
+	Plan best;
+	if (req.item == 0 || req.fpr < 0 || req.fpr >= 1) {
+		return best;
+	}
+	size_t limit = TierLimit(req);
+	if (req.memory_budget != 0) {
+		limit = std::min(limit, req.memory_budget);
+	}
+	if (limit == SIZE_MAX && req.fpr == 0) {
+		return best;	// nothing bounds the search
+	}
+	const bool has_target = req.fpr > 0;
+	bool best_meets = false;
+
+	auto consider = [&](unsigned way, unsigned page_level, unsigned page_num, double fpr) {
+		Plan plan;
+		plan.way = way;
+		plan.page_level = page_level;
+		plan.page_num = page_num;
+		plan.fpr = fpr;
+		plan.probe_cost = ProbeCost(req, way, page_level, plan.data_size());
+		bool meets = has_target && fpr <= req.fpr;
+		if (!best) {
+			best = plan;
+			best_meets = meets;
+			return;
+		}
+		if (meets != best_meets) {
+			if (meets) {
+				best = plan;
+				best_meets = true;
+			}
+			return;
+		}
+		bool better;
+		if (meets) {
+			auto a = static_cast<double>(plan.data_size());
+			auto b = static_cast<double>(best.data_size());
+			if (a < b * 0.95 || a > b * 1.05) {
+				better = a < b;
+			} else {
+				better = plan.probe_cost < best.probe_cost;
+			}
+		} else if (std::abs(fpr - best.fpr) > best.fpr * 0.01) {
+			better = fpr < best.fpr;
+		} else {
+			better = plan.probe_cost < best.probe_cost;
+		}
+		if (better) {
+			best = plan;
+		}
+	};
+
+	for (unsigned way = 4; way <= 8; way++) {
+		for (unsigned page_level = 8 - 8/way; page_level <= 13; page_level++) {
+			size_t max_pages = std::min<size_t>(limit >> page_level, kMaxPageNum - 1);
+			if (max_pages == 0) {
+				continue;
+			}
+			auto max_fpr = PredictFpr(req.item, way, page_level, static_cast<unsigned>(max_pages));
+			if (!has_target || max_fpr > req.fpr) {
+				consider(way, page_level, static_cast<unsigned>(max_pages), max_fpr);
+				continue;
+			}
+			// Predicted FPR falls as pages are added: find the fewest that meet the target.
+			size_t lo = 1, hi = max_pages;
+			while (lo < hi) {
+				size_t mid = lo + (hi - lo) / 2;
+				if (PredictFpr(req.item, way, page_level, static_cast<unsigned>(mid)) <= req.fpr) {
+					hi = mid;
+				} else {
+					lo = mid + 1;
+				}
+			}
+			consider(way, page_level, static_cast<unsigned>(lo),
+					 PredictFpr(req.item, way, page_level, static_cast<unsigned>(lo)));
+		}
+	}
+	return best;
+}
+
+std::unique_ptr<BloomFilter> New(const Plan& plan, HashId hash, uint64_t seed, MemoryResource* resource) {
+	if (!plan) {
+		return nullptr;
+	}
+	return New(plan.way, plan.page_level, plan.page_num, 0, nullptr, hash, seed, resource);
+}
+
+} //pbf
@@ -0,0 +1,109 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "pbf.h"
+#include "pbf-internal.h"
+#include "hash-select.h"
+
+namespace pbf {
+
+namespace {
+
+static FORCE_INLINE void PrefetchPage(unsigned way, const uint8_t* page, unsigned page_level, V128X t) noexcept {
+	switch (way) {
+		case 4: Prefetch<4>(page, page_level, t); break;
+		case 5: Prefetch<5>(page, page_level, t); break;
+		case 6: Prefetch<6>(page, page_level, t); break;
+		case 7: Prefetch<7>(page, page_level, t); break;
+		default: Prefetch<8>(page, page_level, t); break;
+	}
+}
+
+static FORCE_INLINE bool TestPage(unsigned way, const uint8_t* page, unsigned page_level, V128X t) noexcept {
+	switch (way) {
+		case 4: return Test<4>(page, page_level, t);
+		case 5: return Test<5>(page, page_level, t);
+		case 6: return Test<6>(page, page_level, t);
+		case 7: return Test<7>(page, page_level, t);
+		default: return Test<8>(page, page_level, t);
+	}
+}
+
+// Hash once per group, then locate and prefetch the page of every member.
+template <typename Member, typename Group>
+static FORCE_INLINE void Locate(const std::vector<Member>& members, const std::vector<Group>& groups,
+								const uint8_t* data, unsigned len, V128X* hashes,
+								const uint8_t** pages) noexcept {
+	for (size_t i = 0; i < groups.size(); i++) {
+		hashes[i].v = HashWith(groups[i].hash, data, len, groups[i].seed);
+	}
+	for (size_t i = 0; i < members.size(); i++) {
+		auto& m = members[i];
+		auto t = hashes[m.group];
+		size_t idx = PageHash(t) % m.page_num;
+		pages[i] = m.space + (idx << m.page_level);
+		PrefetchPage(m.way, pages[i], m.page_level, t);
+	}
+}
+
+} // namespace
+
+bool FilterSet::attach(const _PageBloomFilter& filter, unsigned way) {
+	if (!filter || m_members.size() >= kMaxFilters || way < 4 || way > 8) {
+		return false;
+	}
+	size_t group = 0;
+	while (group < m_groups.size()
+		   && (m_groups[group].hash != filter.m_hash || m_groups[group].seed != filter.m_seed)) {
+		group++;
+	}
+	if (group == m_groups.size()) {
+		m_groups.push_back({filter.m_hash, filter.m_seed});
+	}
+	Member m;
+	m.space = filter.data();
+	m.page_num = filter.m_page_num;
+	m.page_level = static_cast<uint8_t>(filter.m_page_level);
+	m.way = static_cast<uint8_t>(way);
+	m.group = static_cast<uint8_t>(group);
+	m_members.push_back(m);
+	return true;
+}
+
+uint64_t FilterSet::test(const uint8_t* data, unsigned len) const noexcept {
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return 0;
+	}
+	V128X hashes[kMaxFilters];
+	const uint8_t* pages[kMaxFilters];
+	Locate(m_members, m_groups, data, len, hashes, pages);
+	uint64_t out = 0;
+	for (size_t i = 0; i < m_members.size(); i++) {
+		auto& m = m_members[i];
+		if (TestPage(m.way, pages[i], m.page_level, hashes[m.group])) {
+			out |= 1ULL << i;
+		}
+	}
+	return out;
+}
+
+bool FilterSet::test_any(const uint8_t* data, unsigned len) const noexcept {
+	data = CheckKey(data, len);
+	if (data == nullptr) {
+		return false;
+	}
+	V128X hashes[kMaxFilters];
+	const uint8_t* pages[kMaxFilters];
+	Locate(m_members, m_groups, data, len, hashes, pages);
+	for (size_t i = 0; i < m_members.size(); i++) {
+		auto& m = m_members[i];
+		if (TestPage(m.way, pages[i], m.page_level, hashes[m.group])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+} //pbf
@@ -0,0 +1,298 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include "pbf.h"
+#include "pbf-shm.h"
+#include "pbf-internal.h"
+#include "hash-select.h"
+
+namespace pbf {
+
+namespace {
+
+constexpr uint32_t kShmMagic = 0x53464250;	// "PBFS"
+constexpr uint8_t kShmVersion = 1;
+
+// Native byte order; the segment is shared between processes of one host.
+struct ShmHeader {
+	uint32_t magic;			// stored last by the creator, with release order
+	uint8_t version;
+	uint8_t way;
+	uint8_t page_level;
+	uint8_t hash;
+	uint32_t page_num;
+	uint32_t reserved;
+	uint64_t seed;
+	uint64_t unique_cnt;	// atomic
+	uint8_t pad[32];
+};
+static_assert(sizeof(ShmHeader) == 64, "the bitmap must start cache line aligned");
+
+using TestFunc = bool (*)(const uint8_t* page, unsigned page_level, V128X t);
+using SetFunc = bool (*)(uint8_t* page, unsigned page_level, V128X t);
+
+template <unsigned N>
+static bool TestPage(const uint8_t* page, unsigned page_level, V128X t) noexcept {
+	return Test<N>(page, page_level, t);
+}
+
+// Set<N> with each bit ORed into its 64-bit word atomically. On little-endian
+// hosts bit i of the page is bit i%64 of word i/64, the same layout as bytes.
+// Bits found already set skip the locked instruction.
+template <unsigned N>
+static bool SetPage(uint8_t* page, unsigned page_level, V128X t) noexcept {
+	auto words = reinterpret_cast<uint64_t*>(page);
+	uint16_t mask = (1U << (page_level+3U)) - 1U;
+	bool fresh = false;
+	for (unsigned i = 0; i < N; i++) {
+		uint16_t idx = t.s[i] & mask;
+		uint64_t bit = 1ULL << (idx & 63U);
+		uint64_t* word = words + (idx >> 6U);
+		if ((__atomic_load_n(word, __ATOMIC_RELAXED) & bit) != 0) {
+			continue;
+		}
+		if ((__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) == 0) {
+			fresh = true;
+		}
+	}
+	return fresh;
+}
+
+static bool PickProbes(unsigned way, TestFunc& test, SetFunc& set) noexcept {
+	switch (way) {
+		case 4: test = TestPage<4>; set = SetPage<4>; return true;
+		case 5: test = TestPage<5>; set = SetPage<5>; return true;
+		case 6: test = TestPage<6>; set = SetPage<6>; return true;
+		case 7: test = TestPage<7>; set = SetPage<7>; return true;
+		case 8: test = TestPage<8>; set = SetPage<8>; return true;
+		default: return false;
+	}
+}
+
+static bool ValidGeometry(unsigned way, unsigned page_level, unsigned page_num) noexcept {
+	return way >= 4 && way <= 8 && page_level >= (8-8/way) && page_level <= 13
+		&& page_num != 0 && page_num < kMaxPageNum;
+}
+
+class SharedBloomFilterImp final : public SharedBloomFilter {
+public:
+	SharedBloomFilterImp(int fd, uint8_t* base, size_t size, bool writable,
+						 TestFunc test, SetFunc set, detail::HashFunc hash) noexcept
+		: m_fd(fd), m_base(base), m_size(size), m_writable(writable),
+		  m_header(reinterpret_cast<ShmHeader*>(base)), m_space(base + sizeof(ShmHeader)),
+		  m_page_num(m_header->page_num), m_test(test), m_set(set), m_hash(hash) {}
+
+	~SharedBloomFilterImp() noexcept override {
+		munmap(m_base, m_size);
+		close(m_fd);
+	}
+
+	unsigned way() const noexcept override { return m_header->way; }
+	unsigned page_level() const noexcept override { return m_header->page_level; }
+	unsigned page_num() const noexcept override { return m_page_num.value(); }
+	HashId hash_id() const noexcept override { return static_cast<HashId>(m_header->hash); }
+	uint64_t seed() const noexcept override { return m_header->seed; }
+	size_t unique_cnt() const noexcept override {
+		return static_cast<size_t>(__atomic_load_n(&m_header->unique_cnt, __ATOMIC_RELAXED));
+	}
+	const uint8_t* data() const noexcept override { return m_space; }
+	int fd() const noexcept override { return m_fd; }
+	bool writable() const noexcept override { return m_writable; }
+
+	bool test(const uint8_t* data, unsigned len) const noexcept override {
+		V128X t;
+		const uint8_t* page = locate(data, len, t);
+		return page != nullptr && m_test(page, m_header->page_level, t);
+	}
+
+	bool set(const uint8_t* data, unsigned len) noexcept override {
+		if (!m_writable) {
+			return false;
+		}
+		V128X t;
+		uint8_t* page = locate(data, len, t);
+		if (page == nullptr || !m_set(page, m_header->page_level, t)) {
+			return false;
+		}
+		__atomic_fetch_add(&m_header->unique_cnt, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	void clear() noexcept override {
+		if (!m_writable) {
+			return;
+		}
+		auto words = reinterpret_cast<uint64_t*>(m_space);
+		for (size_t i = 0; i < data_size() / 8; i++) {
+			__atomic_store_n(words + i, 0, __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&m_header->unique_cnt, 0, __ATOMIC_RELAXED);
+	}
+
+private:
+	int m_fd;
+	uint8_t* m_base;
+	size_t m_size;
+	bool m_writable;
+	ShmHeader* m_header;
+	uint8_t* m_space;
+	Divisor<uint32_t> m_page_num;
+	TestFunc m_test;
+	SetFunc m_set;
+	detail::HashFunc m_hash;
+
+	uint8_t* locate(const uint8_t* data, unsigned len, V128X& t) const noexcept {
+		data = CheckKey(data, len);
+		if (data == nullptr) {
+			return nullptr;
+		}
+		t.v = HashWith(m_hash, data, len, m_header->seed);
+		size_t idx = PageHash(t) % m_page_num;
+		return m_space + (idx << m_header->page_level);
+	}
+};
+
+// Validate the mapped header and wrap the segment, taking ownership of `fd`.
+static std::unique_ptr<SharedBloomFilter> Map(int fd, bool writable) {
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmHeader)) {
+		close(fd);
+		return nullptr;
+	}
+	auto size = static_cast<size_t>(st.st_size);
+	int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+	void* addr = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		close(fd);
+		return nullptr;
+	}
+	auto base = static_cast<uint8_t*>(addr);
+	auto header = reinterpret_cast<const ShmHeader*>(base);
+	TestFunc test = nullptr;
+	SetFunc set = nullptr;
+	detail::HashFunc hash = nullptr;
+	bool ok = __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == kShmMagic
+		&& header->version == kShmVersion
+		&& ValidGeometry(header->way, header->page_level, header->page_num)
+		&& size >= sizeof(ShmHeader) + (static_cast<size_t>(header->page_num) << header->page_level)
+		&& PickProbes(header->way, test, set)
+		&& (hash = ResolveHash(static_cast<HashId>(header->hash))) != nullptr;
+	if (!ok) {
+		munmap(addr, size);
+		close(fd);
+		return nullptr;
+	}
+	return std::make_unique<SharedBloomFilterImp>(fd, base, size, writable, test, set, hash);
+}
+
+static int CreateSegment(const char* name) noexcept {
+	if (name != nullptr) {
+		return shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	}
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+	int fd = memfd_create("pbf", MFD_CLOEXEC);
+	if (fd >= 0 || errno != ENOSYS) {
+		return fd;
+	}
+#endif
+	// No memfd: take a private name and drop it at once.
+	static std::atomic<unsigned> serial(0);
+	for (unsigned retry = 0; retry < 16; retry++) {
+		char tmp[64];
+		snprintf(tmp, sizeof(tmp), "/pbf-%ld-%u", static_cast<long>(getpid()), serial++);
+		int fd = shm_open(tmp, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd >= 0) {
+			shm_unlink(tmp);
+			return fd;
+		}
+		if (errno != EEXIST) {
+			break;
+		}
+	}
+	return -1;
+}
+
+} // namespace
+
+std::unique_ptr<SharedBloomFilter> CreateSharedBloomFilter(const char* name, unsigned way, unsigned page_level,
+		unsigned page_num, HashId hash, uint64_t seed) {
+	if (!ValidGeometry(way, page_level, page_num) || ResolveHash(hash) == nullptr) {
+		return nullptr;
+	}
+	int fd = CreateSegment(name);
+	if (fd < 0) {
+		return nullptr;
+	}
+	const size_t size = sizeof(ShmHeader) + (static_cast<size_t>(page_num) << page_level);
+	void* addr = MAP_FAILED;
+	if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+		addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if (addr == MAP_FAILED) {
+		if (name != nullptr) {
+			shm_unlink(name);
+		}
+		close(fd);
+		return nullptr;
+	}
+	// ftruncate zero-fills, so only the header needs writing.
+	auto header = static_cast<ShmHeader*>(addr);
+	header->version = kShmVersion;
+	header->way = static_cast<uint8_t>(way);
+	header->page_level = static_cast<uint8_t>(page_level);
+	header->hash = static_cast<uint8_t>(hash);
+	header->page_num = page_num;
+	header->seed = seed;
+	__atomic_store_n(&header->magic, kShmMagic, __ATOMIC_RELEASE);
+	munmap(addr, size);
+	auto bf = Map(fd, true);
+	if (bf == nullptr && name != nullptr) {
+		shm_unlink(name);
+	}
+	return bf;
+}
+
+std::unique_ptr<SharedBloomFilter> CreateSharedBloomFilter(const char* name, const Plan& plan,
+		HashId hash, uint64_t seed) {
+	if (!plan) {
+		return nullptr;
+	}
+	return CreateSharedBloomFilter(name, plan.way, plan.page_level, plan.page_num, hash, seed);
+}
+
+std::unique_ptr<SharedBloomFilter> AttachSharedBloomFilter(const char* name, bool writable) {
+	if (name == nullptr) {
+		return nullptr;
+	}
+	int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+	if (fd < 0) {
+		return nullptr;
+	}
+	return Map(fd, writable);
+}
+
+std::unique_ptr<SharedBloomFilter> AttachSharedBloomFilter(int fd, bool writable) {
+	if (fd < 0) {
+		return nullptr;
+	}
+	int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (dup_fd < 0) {
+		return nullptr;
+	}
+	return Map(dup_fd, writable);
+}
+
+bool RemoveSharedBloomFilter(const char* name) noexcept {
+	return name != nullptr && shm_unlink(name) == 0;
+}
+
+} //pbf
@@ -0,0 +1,104 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "pbf.h"
+#include "pbf-stats.h"
+
+#ifdef PBF_ENABLE_STATS
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace pbf {
+
+#ifdef PBF_ENABLE_STATS
+
+namespace {
+
+static void Accumulate(const ThreadOpStats& src, OpStats& dst) noexcept {
+	auto get = [](const ThreadOpStats::Counter& c) { return c.load(std::memory_order_relaxed); };
+	dst.tests += get(src.tests);
+	dst.positives += get(src.positives);
+	dst.sets += get(src.sets);
+	dst.new_inserts += get(src.new_inserts);
+	dst.batches += get(src.batches);
+	for (unsigned i = 0; i < OpStats::kBins; i++) {
+		dst.batch_sizes[i] += get(src.batch_sizes[i]);
+		dst.test_latency[i] += get(src.test_latency[i]);
+		dst.set_latency[i] += get(src.set_latency[i]);
+		dst.batch_latency[i] += get(src.batch_latency[i]);
+	}
+}
+
+struct Registry {
+	std::mutex lock;
+	std::vector<const ThreadOpStats*> live;
+	OpStats retired;	// totals of exited threads
+	// Reference point for converting ticks to nanoseconds.
+	uint64_t start_ticks = StatTicks();
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+};
+
+// Leaked so threads exiting during static destruction can still report.
+static Registry& GlobalRegistry() {
+	static auto registry = new Registry;
+	return *registry;
+}
+
+struct ThreadSlot {
+	ThreadOpStats stats;
+	ThreadSlot() {
+		auto& reg = GlobalRegistry();
+		std::lock_guard<std::mutex> guard(reg.lock);
+		reg.live.push_back(&stats);
+	}
+	~ThreadSlot() {
+		auto& reg = GlobalRegistry();
+		std::lock_guard<std::mutex> guard(reg.lock);
+		Accumulate(stats, reg.retired);
+		reg.live.erase(std::find(reg.live.begin(), reg.live.end(), &stats));
+	}
+};
+
+} // namespace
+
+ThreadOpStats& LocalOpStats() noexcept {
+	static thread_local ThreadSlot slot;
+	return slot.stats;
+}
+
+bool OpStatsEnabled() noexcept {
+	return true;
+}
+
+OpStats SnapshotOpStats() {
+	auto& reg = GlobalRegistry();
+	std::lock_guard<std::mutex> guard(reg.lock);
+	OpStats out = reg.retired;
+	for (auto stats : reg.live) {
+		Accumulate(*stats, out);
+	}
+	out.sample_period = kStatsSamplePeriod;
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - reg.start_time).count();
+	if (ns > 0) {
+		out.ticks_per_ns = static_cast<double>(StatTicks() - reg.start_ticks) / static_cast<double>(ns);
+	}
+	return out;
+}
+
+#else
+
+bool OpStatsEnabled() noexcept {
+	return false;
+}
+
+OpStats SnapshotOpStats() {
+	return {};
+}
+
+#endif
+
+} //pbf
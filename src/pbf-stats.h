@@ -0,0 +1,141 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+#ifndef PAGE_BLOOM_FILTER_STATS_H
+#define PAGE_BLOOM_FILTER_STATS_H
+
+#include "pbf.h"
+#include "hash.h"
+
+#ifdef PBF_ENABLE_STATS
+#include <atomic>
+#include <chrono>
+#if defined(PBF_ARCH_X86_64) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(PBF_ARCH_X86_64)
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace pbf {
+
+#ifdef PBF_ENABLE_STATS
+
+constexpr uint32_t kStatsSamplePeriod = 256;
+
+// Counters of one thread. Only the owner writes them, so updates are a plain
+// load and store; the atomics just make the snapshot reader well defined.
+struct ThreadOpStats {
+	using Counter = std::atomic<uint64_t>;
+	Counter tests{0};
+	Counter positives{0};
+	Counter sets{0};
+	Counter new_inserts{0};
+	Counter batches{0};
+	Counter batch_sizes[OpStats::kBins] = {};
+	Counter test_latency[OpStats::kBins] = {};
+	Counter set_latency[OpStats::kBins] = {};
+	Counter batch_latency[OpStats::kBins] = {};
+	uint32_t countdown = kStatsSamplePeriod;
+};
+
+// Registered on first use, folded into the process totals at thread exit.
+extern ThreadOpStats& LocalOpStats() noexcept;
+
+static FORCE_INLINE uint64_t StatTicks() noexcept {
+#if defined(PBF_ARCH_X86_64)
+	return __rdtsc();
+#elif defined(PBF_ARCH_AARCH64) && !defined(_MSC_VER)
+	uint64_t v;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+	return v;
+#else
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+static FORCE_INLINE void Bump(ThreadOpStats::Counter& c, uint64_t v=1) noexcept {
+	c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+static FORCE_INLINE unsigned Log2Bin(uint64_t v) noexcept {
+	unsigned bin = 0;
+	while (v > 1 && bin < OpStats::kBins - 1) {
+		v >>= 1U;
+		bin++;
+	}
+	return bin;
+}
+
+// Lives for one filter call: counts it and times one call in
+// kStatsSamplePeriod on this thread.
+class OpProbe {
+public:
+	OpProbe() noexcept : m_stats(LocalOpStats()) {
+		if (--m_stats.countdown == 0) {
+			m_stats.countdown = kStatsSamplePeriod;
+			m_start = StatTicks();
+		}
+	}
+
+	bool test(bool hit) noexcept {
+		Bump(m_stats.tests);
+		Bump(m_stats.positives, hit);
+		sample(m_stats.test_latency);
+		return hit;
+	}
+	bool set(bool fresh) noexcept {
+		Bump(m_stats.sets);
+		Bump(m_stats.new_inserts, fresh);
+		sample(m_stats.set_latency);
+		return fresh;
+	}
+	void test_batch(size_t n, const bool* out) noexcept {
+		size_t hits = 0;
+		for (size_t i = 0; i < n; i++) {
+			hits += out[i];
+		}
+		Bump(m_stats.tests, n);
+		Bump(m_stats.positives, hits);
+		batch(n);
+	}
+	void set_batch(size_t n, size_t fresh) noexcept {
+		Bump(m_stats.sets, n);
+		Bump(m_stats.new_inserts, fresh);
+		batch(n);
+	}
+
+private:
+	ThreadOpStats& m_stats;
+	uint64_t m_start = 0;
+
+	void sample(ThreadOpStats::Counter* histogram) noexcept {
+		if (m_start != 0) {
+			Bump(histogram[Log2Bin(StatTicks() - m_start)]);
+		}
+	}
+	void batch(size_t n) noexcept {
+		Bump(m_stats.batches);
+		Bump(m_stats.batch_sizes[Log2Bin(n)]);
+		sample(m_stats.batch_latency);
+	}
+};
+
+#else
+
+// Stats off: every call folds away.
+class OpProbe {
+public:
+	bool test(bool hit) noexcept { return hit; }
+	bool set(bool fresh) noexcept { return fresh; }
+	void test_batch(size_t, const bool*) noexcept {}
+	void set_batch(size_t, size_t) noexcept {}
+};
+
+#endif
+
+} //pbf
+#endif // PAGE_BLOOM_FILTER_STATS_H
@@ -3,18 +3,125 @@
 // license that can be found in the LICENSE file.
 
 #include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <new>
 #include "pbf.h"
 #include "pbf-internal.h"
+#include "hash-select.h"
+#include "pbf-stats.h"
+#include "pbf-inline.h"
 
 namespace pbf {
 
-void _PageBloomFilter::init(unsigned page_level, unsigned page_num, size_t unique_cnt, const uint8_t* data) {
+namespace {
+
+// Over-aligned requests keep the pointer from operator new just below the block.
+class NewDeleteResource final : public MemoryResource {
+public:
+	void* allocate(size_t size, size_t align) noexcept override {
+		if (align <= alignof(std::max_align_t)) {
+			return ::operator new(size, std::nothrow);
+		}
+		auto raw = static_cast<uint8_t*>(::operator new(size + align + sizeof(void*), std::nothrow));
+		if (raw == nullptr) {
+			return nullptr;
+		}
+		auto addr = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + align - 1) & ~(uintptr_t{align} - 1);
+		reinterpret_cast<void**>(addr)[-1] = raw;
+		return reinterpret_cast<void*>(addr);
+	}
+	void deallocate(void* p, size_t, size_t align) noexcept override {
+		if (p != nullptr && align > alignof(std::max_align_t)) {
+			p = static_cast<void**>(p)[-1];
+		}
+		::operator delete(p);
+	}
+};
+
+static std::unique_ptr<uint8_t[], detail::SpaceDeleter> Allocate(MemoryResource* resource, size_t size) noexcept {
+	detail::SpaceDeleter deleter{resource, size};
+	return {static_cast<uint8_t*>(resource->allocate(size, detail::kSpaceAlign)), deleter};
+}
+
+} // namespace
+
+// Leaked so filters in static storage can still free their bitmaps at exit.
+MemoryResource* DefaultMemoryResource() noexcept {
+	static auto resource = new NewDeleteResource;
+	return resource;
+}
+
+PoolMemoryResource::PoolMemoryResource(size_t block_size, size_t blocks_per_slab, MemoryResource* upstream)
+	: m_upstream(upstream != nullptr ? upstream : DefaultMemoryResource()),
+	  m_block_size((std::max(block_size, sizeof(void*)) + detail::kSpaceAlign - 1) & ~(detail::kSpaceAlign - 1)),
+	  m_blocks_per_slab(std::max<size_t>(blocks_per_slab, 1)) {}
+
+PoolMemoryResource::~PoolMemoryResource() {
+	for (auto slab : m_slabs) {
+		m_upstream->deallocate(slab, m_block_size * m_blocks_per_slab, detail::kSpaceAlign);
+	}
+}
+
+void* PoolMemoryResource::allocate(size_t size, size_t align) noexcept {
+	if (size > m_block_size || align > detail::kSpaceAlign) {
+		return m_upstream->allocate(size, align);
+	}
+	if (m_free == nullptr) {
+		auto slab = static_cast<uint8_t*>(m_upstream->allocate(m_block_size * m_blocks_per_slab,
+															   detail::kSpaceAlign));
+		if (slab == nullptr) {
+			return nullptr;
+		}
+		try {
+			m_slabs.push_back(slab);
+		} catch (...) {
+			m_upstream->deallocate(slab, m_block_size * m_blocks_per_slab, detail::kSpaceAlign);
+			return nullptr;
+		}
+		for (size_t i = m_blocks_per_slab; i-- > 0;) {
+			auto block = slab + i * m_block_size;
+			*reinterpret_cast<void**>(block) = m_free;
+			m_free = block;
+		}
+	}
+	auto block = m_free;
+	m_free = *static_cast<void**>(block);
+	return block;
+}
+
+void PoolMemoryResource::deallocate(void* p, size_t size, size_t align) noexcept {
+	if (size > m_block_size || align > detail::kSpaceAlign) {
+		m_upstream->deallocate(p, size, align);
+		return;
+	}
+	*static_cast<void**>(p) = m_free;
+	m_free = p;
+}
+
+void _PageBloomFilter::init(unsigned page_level, unsigned page_num, size_t unique_cnt, const uint8_t* data,
+							HashId hash, uint64_t seed, MemoryResource* resource) {
+	auto func = ResolveHash(hash);
+	if (func == nullptr) {
+		return;
+	}
+	if (resource == nullptr) {
+		resource = DefaultMemoryResource();
+	}
+	auto space = Allocate(resource, static_cast<size_t>(page_num) << page_level);
+	if (space == nullptr) {
+		return;
+	}
+	m_hash_id = hash;
+	m_hash = func;
+	m_seed = seed;
 	m_page_level = page_level;
 	m_page_num = page_num;
-	auto space = std::make_unique<uint8_t[]>(data_size());
 	if (data == nullptr) {
 		m_unique_cnt = 0;
-		memset(space.get(), 0, data_size());
+		if (!resource->zeroed()) {
+			memset(space.get(), 0, data_size());
+		}
 	} else {
 		m_unique_cnt = unique_cnt;
 		memcpy(space.get(), data, data_size());
@@ -24,41 +131,185 @@ void _PageBloomFilter::init(unsigned page_level, unsigned page_num, size_t uniqu
 
 void _PageBloomFilter::clear() noexcept {
 	m_unique_cnt = 0;
-	if (m_space != nullptr) {
+	if (m_space != nullptr && !m_space.get_deleter().resource->discard(m_space.get(), data_size())) {
 		memset(m_space.get(), 0, data_size());
 	}
 }
 
-template <unsigned N>
-bool PageBloomFilter<N>::test(const uint8_t* data, unsigned len) const noexcept {
-	if (data == nullptr) {
-		if (len != 0) return false;
-		static const uint8_t empty_key = 0;
-		data = &empty_key;
+bool _PageBloomFilter::fold(unsigned factor) {
+	if (!foldable(factor)) {
+		return false;
 	}
-	V128X t;
-	t.v = Hash(data, len);
-	size_t idx = PageHash(t) % m_page_num;
-	const uint8_t* page = m_space.get() + (idx << m_page_level);
-	return Test<N>(page, m_page_level, t);
+	const unsigned page_num = m_page_num.value() / factor;
+	const size_t size = static_cast<size_t>(page_num) << m_page_level;
+	auto space = Allocate(m_space.get_deleter().resource, size);
+	if (space == nullptr) {
+		return false;
+	}
+	// The old bitmap is dropped anyway, so fold it in place and keep block 0.
+	FoldPages(m_space.get(), size, factor);
+	memcpy(space.get(), m_space.get(), size);
+	m_space = std::move(space);
+	m_page_num = page_num;
+	return true;
 }
 
-template <unsigned N>
-bool PageBloomFilter<N>::set(const uint8_t* data, unsigned len) noexcept {
-	if (data == nullptr) {
-		if (len != 0) return false;
-		static const uint8_t empty_key = 0;
-		data = &empty_key;
+namespace {
+
+// Scanned pages grouped by fill, finely enough to stand in for the pages
+// themselves when projecting FPR forward.
+struct FillBins {
+	static constexpr unsigned kBins = 256;
+	size_t pages[kBins] = {};
+	double fill[kBins] = {};	// sum over the pages in the bin
+
+	void add(double f) noexcept {
+		auto i = std::min(static_cast<unsigned>(f * kBins), kBins - 1);
+		pages[i]++;
+		fill[i] += f;
+	}
+
+	// Mean page_fill^way once `items` more keys land evenly over `page_num`
+	// pages; each key clears a given zero bit with probability 1-(1-1/b)^way.
+	double fpr_after(double items, unsigned page_num, unsigned way, double page_bits, size_t total) const noexcept {
+		const double keep = std::exp(way * std::log1p(-1.0 / page_bits) * items / page_num);
+		double sum = 0;
+		for (unsigned i = 0; i < kBins; i++) {
+			if (pages[i] != 0) {
+				sum += pages[i] * std::pow(1.0 - (1.0 - fill[i] / pages[i]) * keep, way);
+			}
+		}
+		return sum / total;
+	}
+};
+
+static void ScanPages(const uint8_t* space, unsigned page_level, unsigned page_num, unsigned way,
+					  float target, unsigned sample_step, FilterStats& out) noexcept {
+	sample_step = std::max(sample_step, 1U);
+	const size_t page_size = size_t{1} << page_level;
+	const double page_bits = static_cast<double>(page_size * 8);
+	size_t min_bits = page_size * 8;
+	size_t max_bits = 0;
+	size_t total_bits = 0;
+	double fpr_sum = 0;
+	double items = 0;
+	size_t pages = 0;
+	FillBins bins;
+	for (size_t i = 0; i < page_num; i += sample_step) {
+		size_t bits = PopCount(space + (i << page_level), page_size);
+		double fill = bits / page_bits;
+		min_bits = std::min(min_bits, bits);
+		max_bits = std::max(max_bits, bits);
+		total_bits += bits;
+		fpr_sum += std::pow(fill, way);
+		bins.add(fill);
+		// Invert the expected fill 1-(1-1/b)^(way*n) for n.
+		items += std::log1p(-std::min(fill, 1.0 - 0.5 / page_bits)) / std::log1p(-1.0 / page_bits) / way;
+		out.histogram[std::min<size_t>(bits * FilterStats::kHistogramBins / (page_size * 8),
+									   FilterStats::kHistogramBins - 1)]++;
+		pages++;
+	}
+	out.pages = pages;
+	if (pages == 0) {
+		return;
+	}
+	out.fill_ratio = total_bits / (page_bits * pages);
+	out.min_page_fill = min_bits / page_bits;
+	out.max_page_fill = max_bits / page_bits;
+	out.estimated_fpr = fpr_sum / pages;
+	out.estimated_items = static_cast<size_t>(items * page_num / pages);
+	if (!(target > 0.0f && target < 1.0f) || out.estimated_fpr >= target) {
+		return;
+	}
+	// fpr_after grows with the item count, so bracket the target and bisect.
+	double lo = 0;
+	double hi = page_bits * page_num;
+	for (unsigned i = 0; i < 64 && bins.fpr_after(hi, page_num, way, page_bits, pages) < target; i++) {
+		lo = hi;
+		hi *= 2;
 	}
-	V128X t;
-	t.v = Hash(data, len);
-	size_t idx = PageHash(t) % m_page_num;
-	uint8_t* page = m_space.get() + (idx << m_page_level);
-	if (Set<N>(page, m_page_level, t)) {
-		m_unique_cnt++;
-		return true;
+	for (unsigned i = 0; i < 64 && hi - lo > 0.5; i++) {
+		double mid = (lo + hi) / 2;
+		if (bins.fpr_after(mid, page_num, way, page_bits, pages) < target) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	out.capacity_remaining = static_cast<size_t>(lo);
+}
+
+template <unsigned N, bool Insert, typename KeyAt, typename Emit>
+static size_t Batch(detail::HashFunc hash, uint64_t seed, uint8_t* space, unsigned page_level,
+					const Divisor<uint32_t>& page_num, KeyAt key_at, size_t n, const Emit& emit) noexcept {
+	auto hash_key = [hash, seed](const uint8_t* data, unsigned len) { return HashWith(hash, data, len, seed); };
+	return ProbeBatch<N, Insert>(n, page_level,
+		[&](size_t i, size_t m, V128X* t, bool* valid) { HashEach(key_at, i, m, hash_key, t, valid); },
+		[&](size_t, V128X t) { return space + (static_cast<size_t>(PageHash(t) % page_num) << page_level); },
+		emit);
+}
+
+} // namespace
+
+#define PBF_FIXED_PROBE(n, l) \
+	template struct detail::FixedProbe<n, l>;
+#define PBF_FIXED_PROBE_WAY(n) \
+	PBF_FIXED_PROBE(n, 7) PBF_FIXED_PROBE(n, 8) PBF_FIXED_PROBE(n, 9) PBF_FIXED_PROBE(n, 10) \
+	PBF_FIXED_PROBE(n, 11) PBF_FIXED_PROBE(n, 12) PBF_FIXED_PROBE(n, 13)
+PBF_FIXED_PROBE(4, 6)
+PBF_FIXED_PROBE_WAY(4)
+PBF_FIXED_PROBE_WAY(5)
+PBF_FIXED_PROBE_WAY(6)
+PBF_FIXED_PROBE_WAY(7)
+PBF_FIXED_PROBE_WAY(8)
+#undef PBF_FIXED_PROBE_WAY
+#undef PBF_FIXED_PROBE
+
+template <unsigned N>
+FilterStats PageBloomFilter<N>::stats(float fpr, unsigned sample_step) const noexcept {
+	FilterStats out;
+	if (m_space == nullptr) {
+		return out;
 	}
-	return false;
+	ScanPages(m_space.get(), m_page_level, m_page_num.value(), N, fpr, sample_step, out);
+	return out;
+}
+
+template <unsigned N>
+void PageBloomFilter<N>::test_batch(const uint8_t* const* keys, const unsigned* lens,
+									size_t n, bool* out) const noexcept {
+	OpProbe probe;
+	Batch<N, false>(m_hash, m_seed, m_space.get(), m_page_level, m_page_num, KeyList<>{keys, lens}, n,
+					EmitBools{out});
+	probe.test_batch(n, out);
+}
+
+template <unsigned N>
+size_t PageBloomFilter<N>::set_batch(const uint8_t* const* keys, const unsigned* lens, size_t n) noexcept {
+	OpProbe probe;
+	auto cnt = Batch<N, true>(m_hash, m_seed, m_space.get(), m_page_level, m_page_num, KeyList<>{keys, lens}, n,
+							  EmitNothing{});
+	m_unique_cnt += cnt;
+	probe.set_batch(n, cnt);
+	return cnt;
+}
+
+template <unsigned N>
+void PageBloomFilter<N>::test_batch(const uint8_t* keys, unsigned len, size_t n, bool* out) const noexcept {
+	OpProbe probe;
+	Batch<N, false>(m_hash, m_seed, m_space.get(), m_page_level, m_page_num, KeyStrip{keys, len}, n,
+					EmitBools{out});
+	probe.test_batch(n, out);
+}
+
+template <unsigned N>
+size_t PageBloomFilter<N>::set_batch(const uint8_t* keys, unsigned len, size_t n) noexcept {
+	OpProbe probe;
+	auto cnt = Batch<N, true>(m_hash, m_seed, m_space.get(), m_page_level, m_page_num, KeyStrip{keys, len}, n,
+							  EmitNothing{});
+	m_unique_cnt += cnt;
+	probe.set_batch(n, cnt);
+	return cnt;
 }
 
 template class PageBloomFilter<4>;
@@ -73,8 +324,21 @@ public:
 	size_t capacity() const noexcept { return self()->capacity(); }
 	size_t virtual_capacity(float fpr) const noexcept { return self()->virtual_capacity(fpr); }
 	unsigned way() const noexcept { return self()->way(); }
+	FilterStats stats(float fpr, unsigned sample_step) const noexcept { return self()->stats(fpr, sample_step); }
 	bool test(const uint8_t* data, unsigned len) const noexcept { return self()->test(data, len); }
 	bool set(const uint8_t* data, unsigned len) noexcept { return self()->set(data, len); }
+	void test_batch(const uint8_t* const* keys, const unsigned* lens, size_t n, bool* out) const noexcept {
+		self()->test_batch(keys, lens, n, out);
+	}
+	size_t set_batch(const uint8_t* const* keys, const unsigned* lens, size_t n) noexcept {
+		return self()->set_batch(keys, lens, n);
+	}
+	void test_batch(const uint8_t* keys, unsigned len, size_t n, bool* out) const noexcept {
+		self()->test_batch(keys, len, n, out);
+	}
+	size_t set_batch(const uint8_t* keys, unsigned len, size_t n) noexcept {
+		return self()->set_batch(keys, len, n);
+	}
 
 	explicit BloomFilterImp(PageBloomFilter<N>&& bf) {
 		// Design note:
@@ -106,11 +370,11 @@ template class BloomFilterImp<6>;
 template class BloomFilterImp<7>;
 template class BloomFilterImp<8>;
 
-std::unique_ptr<BloomFilter> New(size_t item, float fpr) {
+std::unique_ptr<BloomFilter> New(size_t item, float fpr, HashId hash, uint64_t seed, MemoryResource* resource) {
 #define PBF_NEW_CASE(w) \
 	case w:                												\
 	{                   												\
-		auto tmp = Create< w >(item, fpr);								\
+		auto tmp = Create< w >(item, fpr, hash, seed, resource);			\
 		if (!tmp) {														\
 			return nullptr;												\
 		}																\
@@ -128,11 +392,12 @@ std::unique_ptr<BloomFilter> New(size_t item, float fpr) {
 }
 
 std::unique_ptr<BloomFilter> New(unsigned way, unsigned page_level, unsigned page_num,
-								 size_t unique_cnt, const uint8_t* data) {
+								 size_t unique_cnt, const uint8_t* data, HashId hash, uint64_t seed,
+								 MemoryResource* resource) {
 #define PBF_NEW_CASE(w) \
 	case w:                													\
 	{                   													\
-		PageBloomFilter< w > tmp(page_level, page_num, unique_cnt, data);	\
+		PageBloomFilter< w > tmp(page_level, page_num, unique_cnt, data, hash, seed, resource);	\
 		if (!tmp) {															\
 			return nullptr;													\
 		}																	\
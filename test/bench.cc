@@ -5,30 +5,45 @@
 #include <chrono>
 #include <iostream>
 #include "pbf.h"
+#include "perf-counter.h"
 
 int main(int argc, char* argv[]) {
 #ifndef BENCHMARK_WAY
 	#define BENCHMARK_WAY 8
 #endif
 	pbf::PageBloomFilter< BENCHMARK_WAY > bf(12, 250);
+	PerfCounters perf;
+	if (!perf.available()) {
+		std::cout << "perf counters unavailable" << std::endl;
+	}
 
 	const uint64_t n = 1000000;
 
+	perf.start();
 	auto start = std::chrono::steady_clock::now();
 	for (uint64_t i = 0; i < n; i += 2) {
 		bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
 	}
 	auto end = std::chrono::steady_clock::now();
+	auto counters = PerfCounters::Format(perf.stop(), n/2);
 	auto delta = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 	std::cout << "set: " << static_cast<double>(delta)/(n/2) << "ns/op" << std::endl;
+	if (!counters.empty()) {
+		std::cout << "  " << counters << std::endl;
+	}
 
+	perf.start();
 	start = std::chrono::steady_clock::now();
 	for (uint64_t i = 0; i < n; i++) {
 		bf.test(reinterpret_cast<const uint8_t*>(&i), 8);
 	}
 	end = std::chrono::steady_clock::now();
+	counters = PerfCounters::Format(perf.stop(), n);
 
 	delta = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 	std::cout << "test: " << static_cast<double>(delta)/n << "ns/op" << std::endl;
+	if (!counters.empty()) {
+		std::cout << "  " << counters << std::endl;
+	}
 	return 0;
-}
\ No newline at end of file
+}
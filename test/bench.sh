@@ -9,7 +9,7 @@ ${COMPILE} set-wrapper.cc set-bench.cc
 	done
 echo ""
 
-SOURCE="../src/hash.cc ../src/pbf.cc bench.cc"
+SOURCE="../src/hash.cc ../src/hash-select.cc ../src/hash-accel.cc ../src/pbf.cc bench.cc"
 
 for w in 4 5 6 7 8; do
 	echo "way-${w}"
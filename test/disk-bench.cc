@@ -0,0 +1,86 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include "pbf.h"
+#include "pbf-disk.h"
+
+// usage: disk-bench [file] [page_num]
+int main(int argc, char* argv[]) {
+	const char* path = argc > 1 ? argv[1] : "pbf-disk-bench.bin";
+	unsigned page_num = argc > 2 ? std::stoul(argv[2]) : 32768;	// 128MB with 4KB pages
+	const unsigned page_level = 12;
+	const uint64_t n = 1000000;
+
+	pbf::PageBloomFilter<8> bf(page_level, page_num);
+	if (!bf) {
+		std::cerr << "bad page_num" << std::endl;
+		return 1;
+	}
+	for (uint64_t i = 0; i < n; i += 2) {
+		bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	{
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(bf.data()), bf.data_size());
+		if (!out) {
+			std::cerr << "fail to write " << path << std::endl;
+			return 1;
+		}
+	}
+
+	std::mt19937_64 rng(n);
+	std::vector<uint64_t> keys(n);
+	for (auto& key : keys) {
+		key = rng() % n;
+	}
+
+	auto run = [&](const char* name, const pbf::DiskBloomFilter::Options& opt) {
+		auto disk = pbf::OpenDiskBloomFilter(path, 8, page_level, page_num, 0, opt);
+		if (disk == nullptr) {
+			std::cerr << "fail to open " << path << std::endl;
+			return;
+		}
+		std::atomic<uint64_t> hit(0);
+		auto start = std::chrono::steady_clock::now();
+		for (auto key : keys) {
+			disk->test(reinterpret_cast<const uint8_t*>(&key), 8, [&hit](bool r) {
+				if (r) hit.fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		disk->wait();
+		auto end = std::chrono::steady_clock::now();
+		auto delta = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		std::cout << name << "-" << disk->backend() << ": " << static_cast<double>(delta)/n << "ns/op"
+				  << " (hit " << hit.load() << "/" << n << ")" << std::endl;
+	};
+
+	pbf::DiskBloomFilter::Options opt;
+	opt.batch_size = 4096;
+	opt.queue_depth = 128;
+	opt.use_io_uring = true;
+	run("disk", opt);
+	opt.use_io_uring = false;
+	run("disk", opt);
+	opt.use_io_uring = true;
+	opt.cache_pages = page_num / 4;
+	run("disk-cache", opt);
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto key : keys) {
+		bf.test(reinterpret_cast<const uint8_t*>(&key), 8);
+	}
+	auto end = std::chrono::steady_clock::now();
+	auto delta = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	std::cout << "memory: " << static_cast<double>(delta)/n << "ns/op" << std::endl;
+
+	std::remove(path);
+	return 0;
+}
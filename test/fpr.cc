@@ -0,0 +1,356 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Empirical false positive rate measurement.
+//
+// geometry: every (way, page_level) pair, filled to fractions of capacity(),
+//           observed FPR against the closed-form standard bloom estimate.
+// sizing:   filters from New(item, fpr), filled to fractions of `item`, with
+//           the load where observed FPR crosses the target. A crossing above
+//           1.0 means Create over-provisions, below 1.0 means it falls short.
+// placement: PageBloomFilter against TwoChoiceBloomFilter on bitmaps of the
+//           same size, with the bytes of fill counters the latter adds.
+//
+// usage: pbf-fpr [--keys=seq|random|text] [--hash=spooky|xxh3|aesni|crc32c]
+//                [--threads=N] [--probes=N] [--size=BYTES]
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <functional>
+#include "pbf.h"
+
+namespace {
+
+enum class KeyKind { kSequential, kRandom, kText };
+
+struct Options {
+	KeyKind keys = KeyKind::kRandom;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+	size_t probes = 1000000;
+	size_t size = size_t{1} << 22;
+	pbf::HashId hash = pbf::DefaultHash();
+} g_opt;
+
+uint64_t Mix(uint64_t x) noexcept {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27U)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31U);
+}
+
+// Key `id` of a stream: members and probes come from disjoint streams.
+class KeyMaker {
+public:
+	KeyMaker(uint64_t stream) : m_stream(stream << 56U) {}
+
+	const uint8_t* operator()(uint64_t id, unsigned& len) {
+		id |= m_stream;
+		switch (g_opt.keys) {
+			case KeyKind::kSequential:
+				m_word = id;
+				len = 8;
+				return reinterpret_cast<const uint8_t*>(&m_word);
+			case KeyKind::kRandom:
+				m_word = Mix(id);
+				len = 8;
+				return reinterpret_cast<const uint8_t*>(&m_word);
+			case KeyKind::kText:
+			default:
+				m_text = "user:" + std::to_string(id >> 56U) + ":" + std::to_string(id & 0xffffffffffffffULL);
+				len = static_cast<unsigned>(m_text.size());
+				return reinterpret_cast<const uint8_t*>(m_text.data());
+		}
+	}
+
+private:
+	uint64_t m_stream;
+	uint64_t m_word = 0;
+	std::string m_text;
+};
+
+template <typename Filter>
+void Fill(Filter& bf, uint64_t from, uint64_t to) {
+	KeyMaker member(0);
+	for (uint64_t i = from; i < to; i++) {
+		unsigned len;
+		auto key = member(i, len);
+		bf.set(key, len);
+	}
+}
+
+template <typename Filter>
+double Measure(const Filter& bf, size_t& hit) {
+	KeyMaker stranger(1);
+	hit = 0;
+	for (uint64_t i = 0; i < g_opt.probes; i++) {
+		unsigned len;
+		auto key = stranger(i, len);
+		hit += bf.test(key, len);
+	}
+	return static_cast<double>(hit) / g_opt.probes;
+}
+
+// 95% Wilson score interval.
+void Wilson(size_t hit, size_t n, double& lo, double& hi) {
+	constexpr double z = 1.96;
+	double p = static_cast<double>(hit) / n;
+	double d = 1 + z*z/n;
+	double c = (p + z*z/(2*n)) / d;
+	double h = z * std::sqrt(p*(1-p)/n + z*z/(4.0*n*n)) / d;
+	lo = std::max(c - h, 0.0);
+	hi = std::min(c + h, 1.0);
+}
+
+std::string Sci(double x) {
+	std::ostringstream out;
+	out << std::scientific << std::setprecision(3) << x;
+	return out.str();
+}
+
+void RunParallel(size_t n, const std::function<void(size_t)>& job) {
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < g_opt.threads; i++) {
+		workers.emplace_back([&]() {
+			for (size_t k; (k = next.fetch_add(1)) < n;) {
+				job(k);
+			}
+		});
+	}
+	for (auto& t : workers) {
+		t.join();
+	}
+}
+
+const double kGeometryFills[] = {0.25, 0.5, 0.75, 1.0};
+
+void Geometry() {
+	struct Case {
+		unsigned way;
+		unsigned page_level;
+	};
+	std::vector<Case> cases;
+	for (unsigned way = 4; way <= 8; way++) {
+		for (unsigned level = 8 - 8/way; level <= 13; level++) {
+			cases.push_back({way, level});
+		}
+	}
+	std::vector<std::string> rows(cases.size());
+	RunParallel(cases.size(), [&](size_t k) {
+		auto& c = cases[k];
+		size_t page_num = std::max<size_t>(g_opt.size >> c.page_level, 1);
+		page_num = std::min<size_t>(page_num, pbf::kMaxPageNum - 1);
+		auto bf = pbf::New(c.way, c.page_level, static_cast<unsigned>(page_num), 0, nullptr, g_opt.hash);
+		std::ostringstream out;
+		size_t filled = 0;
+		for (auto fill : kGeometryFills) {
+			auto items = static_cast<size_t>(fill * bf->capacity());
+			Fill(*bf, filled, items);
+			filled = items;
+			size_t hit;
+			double fpr = Measure(*bf, hit);
+			double lo, hi;
+			Wilson(hit, g_opt.probes, lo, hi);
+			// Standard bloom filter with the same bits and hash count.
+			double m = static_cast<double>(bf->data_size()) * 8;
+			double k = c.way;
+			double model = std::pow(-std::expm1(-k * static_cast<double>(items) / m), k);
+			out << c.way << '\t' << c.page_level << '\t' << bf->data_size() << '\t'
+				<< std::fixed << std::setprecision(2) << fill << '\t'
+				<< Sci(fpr) << '\t' << '[' << Sci(lo) << ", " << Sci(hi) << "]\t"
+				<< Sci(model) << '\t' << std::setprecision(3) << fpr / model << '\n';
+		}
+		rows[k] = out.str();
+	});
+	std::cout << "# hash: " << pbf::HashName(g_opt.hash) << "\n\n"
+			  << "# geometry: observed FPR by load (fraction of capacity())\n"
+			  << "way\tlevel\tbytes\tload\tfpr\t95%-ci\tstandard\tratio\n";
+	for (auto& row : rows) {
+		std::cout << row;
+	}
+	std::cout << std::endl;
+}
+
+const double kSizingFills[] = {0.5, 0.75, 0.9, 1.0, 1.1, 1.25, 1.5};
+
+void Sizing() {
+	struct Case {
+		float fpr;
+		size_t item;
+	};
+	const float targets[] = {0.1f, 0.05f, 0.03f, 0.02f, 0.01f, 0.005f, 0.002f, 0.001f, 0.0005f};
+	const size_t items[] = {1000, 100000, 1000000};
+	std::vector<Case> cases;
+	for (auto fpr : targets) {
+		for (auto item : items) {
+			cases.push_back({fpr, item});
+		}
+	}
+	std::vector<std::string> rows(cases.size());
+	RunParallel(cases.size(), [&](size_t k) {
+		auto& c = cases[k];
+		auto bf = pbf::New(c.item, c.fpr, g_opt.hash);
+		if (bf == nullptr) {
+			return;
+		}
+		std::ostringstream out;
+		out << c.fpr << '\t' << c.item << '\t' << bf->way() << '\t' << bf->page_level() << '\t'
+			<< bf->data_size() << '\t' << std::fixed << std::setprecision(3)
+			<< bf->data_size() * 8.0 / c.item << '\t';
+		size_t filled = 0;
+		double prev_fill = 0, prev_fpr = 0;
+		double crossing = -1;
+		double at_item = 0, at_lo = 0, at_hi = 0;
+		for (auto fill : kSizingFills) {
+			auto n = static_cast<size_t>(fill * c.item);
+			Fill(*bf, filled, n);
+			filled = n;
+			size_t hit;
+			double fpr = Measure(*bf, hit);
+			if (fill == 1.0) {
+				at_item = fpr;
+				Wilson(hit, g_opt.probes, at_lo, at_hi);
+			}
+			if (crossing < 0 && fpr > c.fpr) {
+				// Interpolate in log space between the bracketing loads.
+				if (prev_fpr > 0 && prev_fill > 0) {
+					double r = (std::log(c.fpr) - std::log(prev_fpr)) / (std::log(fpr) - std::log(prev_fpr));
+					crossing = prev_fill + r * (fill - prev_fill);
+				} else {
+					crossing = fill;
+				}
+			}
+			prev_fill = fill;
+			prev_fpr = fpr;
+		}
+		out << Sci(at_item) << "\t[" << Sci(at_lo) << ", " << Sci(at_hi) << "]\t";
+		if (crossing < 0) {
+			out << ">" << kSizingFills[sizeof(kSizingFills)/sizeof(double)-1] << "\tover";
+		} else {
+			out << std::setprecision(3) << crossing << '\t'
+				<< (crossing > 1.05 ? "over" : (crossing < 0.95 ? "under" : "ok"));
+		}
+		out << '\n';
+		rows[k] = out.str();
+	});
+	std::cout << "# sizing: New(item, fpr) filled to fractions of item\n"
+			  << "# crossing: load where observed FPR reaches the target; memory could scale by 1/crossing\n"
+			  << "target\titem\tway\tlevel\tbytes\tbits/item\tfpr@item\t95%-ci\tcrossing\tverdict\n";
+	for (auto& row : rows) {
+		std::cout << row;
+	}
+	std::cout << std::endl;
+}
+
+const double kPlacementFills[] = {0.5, 0.75, 1.0};
+
+template <unsigned N>
+std::string Placement(unsigned page_level) {
+	size_t page_num = std::max<size_t>(g_opt.size >> page_level, 1);
+	page_num = std::min<size_t>(page_num, pbf::kMaxPageNum - 1);
+	pbf::PageBloomFilter<N> one(page_level, static_cast<unsigned>(page_num), 0, nullptr, g_opt.hash);
+	pbf::TwoChoiceBloomFilter<N> two(page_level, static_cast<unsigned>(page_num), 0, nullptr, g_opt.hash);
+	std::ostringstream out;
+	size_t filled = 0;
+	for (auto fill : kPlacementFills) {
+		auto items = static_cast<size_t>(fill * one.capacity());
+		Fill(one, filled, items);
+		Fill(two, filled, items);
+		filled = items;
+		size_t hit;
+		double fpr_one = Measure(one, hit);
+		double fpr_two = Measure(two, hit);
+		out << N << '\t' << page_level << '\t' << one.data_size() << '\t' << page_num * sizeof(uint16_t) << '\t'
+			<< std::fixed << std::setprecision(2) << fill << '\t' << Sci(fpr_one) << '\t' << Sci(fpr_two) << '\t'
+			<< std::setprecision(3) << (fpr_one > 0 ? fpr_two / fpr_one : 0.0) << '\n';
+	}
+	return out.str();
+}
+
+void Placement() {
+	struct Case {
+		unsigned way;
+		unsigned page_level;
+	};
+	std::vector<Case> cases;
+	for (unsigned way = 4; way <= 8; way++) {
+		for (unsigned level : {8 - 8/way, 9U, 12U}) {
+			cases.push_back({way, level});
+		}
+	}
+	std::vector<std::string> rows(cases.size());
+	RunParallel(cases.size(), [&](size_t k) {
+		auto& c = cases[k];
+		switch (c.way) {
+			case 4: rows[k] = Placement<4>(c.page_level); break;
+			case 5: rows[k] = Placement<5>(c.page_level); break;
+			case 6: rows[k] = Placement<6>(c.page_level); break;
+			case 7: rows[k] = Placement<7>(c.page_level); break;
+			default: rows[k] = Placement<8>(c.page_level); break;
+		}
+	});
+	std::cout << "# placement: one page per key against the less filled of two, same bitmap\n"
+			  << "# counters: extra bytes of per-page fill counters in the two-choice filter\n"
+			  << "way\tlevel\tbytes\tcounters\tload\tstandard\ttwo-choice\tratio\n";
+	for (auto& row : rows) {
+		std::cout << row;
+	}
+	std::cout << std::endl;
+}
+
+bool ParseHash(const std::string& name, pbf::HashId& out) {
+	const pbf::HashId ids[] = {
+		pbf::HashId::kSpooky, pbf::HashId::kXXH3, pbf::HashId::kAESNI, pbf::HashId::kCRC32C,
+	};
+	for (auto id : ids) {
+		if (name == pbf::HashName(id)) {
+			out = id;
+			return pbf::HashAvailable(id);
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--keys=seq") {
+			g_opt.keys = KeyKind::kSequential;
+		} else if (arg == "--keys=random") {
+			g_opt.keys = KeyKind::kRandom;
+		} else if (arg == "--keys=text") {
+			g_opt.keys = KeyKind::kText;
+		} else if (arg.compare(0, 10, "--threads=") == 0) {
+			g_opt.threads = std::max(std::stoul(arg.substr(10)), 1UL);
+		} else if (arg.compare(0, 9, "--probes=") == 0) {
+			g_opt.probes = std::max(std::stoull(arg.substr(9)), 1ULL);
+		} else if (arg.compare(0, 7, "--size=") == 0) {
+			g_opt.size = std::stoull(arg.substr(7));
+		} else if (arg.compare(0, 7, "--hash=") == 0) {
+			if (!ParseHash(arg.substr(7), g_opt.hash)) {
+				std::cerr << "hash " << arg.substr(7) << " is not available" << std::endl;
+				return 1;
+			}
+		} else {
+			std::cerr << "usage: " << argv[0]
+					  << " [--keys=seq|random|text] [--threads=N] [--probes=N] [--size=BYTES]" << std::endl;
+			return 1;
+		}
+	}
+	Geometry();
+	Sizing();
+	Placement();
+	return 0;
+}
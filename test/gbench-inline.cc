@@ -0,0 +1,31 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Probe loops built with PBF_HEADER_ONLY for the inline/* benchmarks. gbench.cc
+// runs the same loops against the library.
+
+#include "pbf.h"
+
+template <unsigned Len>
+size_t HeaderOnlyTest(const pbf::PageBloomFilter<8>& bf, const uint8_t* keys, size_t n) {
+	size_t positive = 0;
+	for (size_t i = 0; i < n; i++) {
+		positive += bf.test(keys + i * Len, Len);
+	}
+	return positive;
+}
+
+template <unsigned Len>
+size_t HeaderOnlySet(pbf::PageBloomFilter<8>& bf, const uint8_t* keys, size_t n) {
+	size_t fresh = 0;
+	for (size_t i = 0; i < n; i++) {
+		fresh += bf.set(keys + i * Len, Len);
+	}
+	return fresh;
+}
+
+template size_t HeaderOnlyTest<8>(const pbf::PageBloomFilter<8>&, const uint8_t*, size_t);
+template size_t HeaderOnlyTest<16>(const pbf::PageBloomFilter<8>&, const uint8_t*, size_t);
+template size_t HeaderOnlySet<8>(pbf::PageBloomFilter<8>&, const uint8_t*, size_t);
+template size_t HeaderOnlySet<16>(pbf::PageBloomFilter<8>&, const uint8_t*, size_t);
@@ -0,0 +1,981 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Parameter sweep over way, page_level, filter size, key shape, hit ratio,
+// hash backend and single/batch APIs in one run, plus compile-time against
+// runtime geometry, one key against several filters and thread scaling on one
+// shared filter. Results are JSON
+// unless another format is requested, e.g.
+//   pbf-gbench --benchmark_out=pbf.json --benchmark_filter=way:8
+// Pass --max_size=<bytes> to extend the size sweep (default 256MB).
+
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <thread>
+#include "pbf.h"
+#include "perf-counter.h"
+#if defined(__unix__) || defined(__APPLE__)
+#define PBF_GBENCH_SHM 1
+#include "pbf-shm.h"
+#endif
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Built with PBF_HEADER_ONLY in gbench-inline.cc.
+template <unsigned Len>
+size_t HeaderOnlyTest(const pbf::PageBloomFilter<8>& bf, const uint8_t* keys, size_t n);
+template <unsigned Len>
+size_t HeaderOnlySet(pbf::PageBloomFilter<8>& bf, const uint8_t* keys, size_t n);
+
+namespace {
+
+enum KeyShape : unsigned {
+	kFixed8, kFixed16, kFixed64, kVariable,
+};
+const char* const kKeyShapeName[] = {"u64", "fixed16", "fixed64", "var4-64"};
+
+struct Config {
+	unsigned way;
+	unsigned page_level;
+	size_t size;
+	KeyShape shape;
+	bool random;
+	unsigned hit_percent;
+	bool batch;
+	pbf::HashId hash;
+};
+
+size_t g_max_size = size_t{256} << 20;
+
+PerfCounters& Perf() {
+	static PerfCounters perf;
+	return perf;
+}
+
+// Per-op hardware counters, omitted when perf events are unavailable.
+void Accumulate(PerfCounters::Sample& total, const PerfCounters::Sample& part) {
+	for (unsigned i = 0; i < PerfCounters::kEventNum; i++) {
+		total.value[i] = part.value[i] < 0 ? -1 : total.value[i] + part.value[i];
+	}
+}
+
+void ReportPerf(benchmark::State& state, const PerfCounters::Sample& sample, size_t ops) {
+	for (unsigned i = 0; i < PerfCounters::kEventNum; i++) {
+		if (sample.value[i] >= 0) {
+			state.counters[PerfCounters::Name(i)] = sample.value[i] / ops;
+		}
+	}
+}
+
+uint64_t Mix(uint64_t x) noexcept {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27U)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31U);
+}
+
+class KeySet {
+public:
+	KeySet(KeyShape shape, bool random, uint64_t first, uint64_t step, size_t n) {
+		m_offsets.reserve(n + 1);
+		m_offsets.push_back(0);
+		for (size_t i = 0; i < n; i++) {
+			uint64_t id = first + i * step;
+			uint64_t word = random ? Mix(id) : id;
+			unsigned len = 8;
+			switch (shape) {
+				case kFixed8: len = 8; break;
+				case kFixed16: len = 16; break;
+				case kFixed64: len = 64; break;
+				case kVariable: len = 4 + Mix(id ^ 0x5555) % 61; break;
+			}
+			auto off = m_buf.size();
+			m_buf.resize(off + len, static_cast<uint8_t>(id));
+			memcpy(&m_buf[off], &word, std::min(len, 8U));
+			m_offsets.push_back(m_buf.size());
+		}
+		m_keys.reserve(n);
+		m_lens.reserve(n);
+		for (size_t i = 0; i < n; i++) {
+			m_keys.push_back(m_buf.data() + m_offsets[i]);
+			m_lens.push_back(static_cast<unsigned>(m_offsets[i+1] - m_offsets[i]));
+		}
+	}
+
+	size_t size() const noexcept { return m_keys.size(); }
+	const uint8_t* const* keys() const noexcept { return m_keys.data(); }
+	const unsigned* lens() const noexcept { return m_lens.data(); }
+	size_t bytes() const noexcept { return m_buf.size(); }
+
+private:
+	std::vector<uint8_t> m_buf;
+	std::vector<size_t> m_offsets;
+	std::vector<const uint8_t*> m_keys;
+	std::vector<unsigned> m_lens;
+};
+
+// Members use even ids and strangers odd ids, so hit ratio is exact.
+std::shared_ptr<pbf::BloomFilter> FilledFilter(const Config& cfg) {
+	static std::map<std::tuple<unsigned, unsigned, size_t, unsigned, bool, pbf::HashId>,
+					std::shared_ptr<pbf::BloomFilter>> cache;
+	auto id = std::make_tuple(cfg.way, cfg.page_level, cfg.size, static_cast<unsigned>(cfg.shape), cfg.random, cfg.hash);
+	auto it = cache.find(id);
+	if (it != cache.end()) {
+		return it->second;
+	}
+	cache.clear();	// keep at most one large bitmap alive
+	std::shared_ptr<pbf::BloomFilter> bf(pbf::New(cfg.way, cfg.page_level,
+			static_cast<unsigned>(cfg.size >> cfg.page_level), 0, nullptr, cfg.hash).release());
+	// Fill to half of the nominal capacity, the middle of the recommended load.
+	size_t total = bf->capacity() / 2;
+	constexpr size_t kChunk = 1U << 16U;
+	for (size_t i = 0; i < total; i += kChunk) {
+		KeySet keys(cfg.shape, cfg.random, i * 2, 2, std::min(kChunk, total - i));
+		bf->set_batch(keys.keys(), keys.lens(), keys.size());
+	}
+	cache.emplace(id, bf);
+	return bf;
+}
+
+void Probe(benchmark::State& state, Config cfg) {
+	auto bf = FilledFilter(cfg);
+	size_t members = bf->capacity() / 2;
+
+	constexpr size_t kQueries = 1U << 18U;
+	constexpr size_t kBatch = 64;
+	// Interleave members and strangers according to the hit ratio.
+	KeySet hits(cfg.shape, cfg.random, 0, 2, std::min(kQueries, members));
+	KeySet misses(cfg.shape, cfg.random, 1, 2, kQueries);
+	std::vector<const uint8_t*> keys(kQueries);
+	std::vector<unsigned> lens(kQueries);
+	for (size_t i = 0; i < kQueries; i++) {
+		bool hit = Mix(i) % 100 < cfg.hit_percent;
+		size_t j = hit ? Mix(i + kQueries) % hits.size() : i;
+		keys[i] = hit ? hits.keys()[j] : misses.keys()[j];
+		lens[i] = hit ? hits.lens()[j] : misses.lens()[j];
+	}
+
+	std::unique_ptr<bool[]> out(new bool[kBatch]);
+	size_t pos = 0;
+	size_t positive = 0;
+	Perf().start();
+	for (auto _ : state) {
+		if (cfg.batch) {
+			bf->test_batch(&keys[pos], &lens[pos], kBatch, out.get());
+			benchmark::DoNotOptimize(out[kBatch-1]);
+		} else {
+			for (size_t i = pos; i < pos + kBatch; i++) {
+				positive += bf->test(keys[i], lens[i]);
+			}
+		}
+		pos = (pos + kBatch) % kQueries;
+	}
+	ReportPerf(state, Perf().stop(), state.iterations() * kBatch);
+	benchmark::DoNotOptimize(positive);
+	state.SetItemsProcessed(state.iterations() * kBatch);
+	state.counters["way"] = cfg.way;
+	state.counters["page_level"] = cfg.page_level;
+	state.counters["bytes"] = static_cast<double>(cfg.size);
+	state.counters["hit_ratio"] = cfg.hit_percent / 100.0;
+	state.SetLabel(std::string("hash=") + pbf::HashName(cfg.hash) + " key=" + kKeyShapeName[cfg.shape]
+				   + (cfg.random ? " random" : " sequential") + (cfg.batch ? " batch" : " single"));
+}
+
+void Insert(benchmark::State& state, Config cfg) {
+	std::unique_ptr<pbf::BloomFilter> bf(pbf::New(cfg.way, cfg.page_level,
+			static_cast<unsigned>(cfg.size >> cfg.page_level), 0, nullptr, cfg.hash));
+	// Keep load bounded: restart from an empty filter once half full.
+	size_t limit = bf->capacity() / 2;
+	constexpr size_t kBatch = 64;
+	KeySet keys(cfg.shape, cfg.random, 0, 1, std::max<size_t>(std::min<size_t>(limit, 1U << 18U), kBatch));
+	size_t pos = 0;
+	PerfCounters::Sample perf = {};
+	Perf().start();
+	for (auto _ : state) {
+		if (cfg.batch) {
+			bf->set_batch(keys.keys() + pos, keys.lens() + pos, kBatch);
+		} else {
+			for (size_t i = pos; i < pos + kBatch; i++) {
+				bf->set(keys.keys()[i], keys.lens()[i]);
+			}
+		}
+		pos += kBatch;
+		if (pos + kBatch > keys.size()) {
+			pos = 0;
+			state.PauseTiming();
+			Accumulate(perf, Perf().stop());
+			bf->clear();
+			Perf().start();
+			state.ResumeTiming();
+		}
+	}
+	Accumulate(perf, Perf().stop());
+	ReportPerf(state, perf, state.iterations() * kBatch);
+	state.SetItemsProcessed(state.iterations() * kBatch);
+	state.counters["way"] = cfg.way;
+	state.counters["page_level"] = cfg.page_level;
+	state.counters["bytes"] = static_cast<double>(cfg.size);
+	state.SetLabel(std::string("hash=") + pbf::HashName(cfg.hash) + " key=" + kKeyShapeName[cfg.shape]
+				   + (cfg.random ? " random" : " sequential") + (cfg.batch ? " batch" : " single"));
+}
+
+// Half-full fixture shared by the geometry, dispatch and inline cases:
+// members are Mix(2i) below half the capacity, zero padded to Len bytes, and
+// queries alternate members and strangers. Each iteration probes the next
+// kWindowBatch keys of a kWindowKeys window.
+constexpr size_t kWindowKeys = 1U << 16U;
+constexpr size_t kWindowBatch = 64;
+
+template <unsigned Len, typename Filter>
+void FillHalf(Filter& bf) {
+	static_assert(Len == 8 || Len == 16, "keys are one or two words");
+	for (uint64_t i = 0; i < bf.capacity() / 2; i++) {
+		uint64_t key[2] = {Mix(i * 2), 0};
+		bf.set(reinterpret_cast<const uint8_t*>(key), Len);
+	}
+}
+
+// probe(keys) handles kWindowBatch packed keys and returns a count that is
+// kept alive. Reports per-op counters, `bytes` and the default hash.
+template <unsigned Len, typename ProbeOp>
+void RunWindow(benchmark::State& state, size_t capacity, size_t bytes, const ProbeOp& probe,
+			   const char* tag = "") {
+	static_assert(Len == 8 || Len == 16, "keys are one or two words");
+	std::vector<uint8_t> keys(kWindowKeys * Len);
+	for (size_t i = 0; i < kWindowKeys; i++) {
+		uint64_t key[2] = {Mix(i % (capacity / 2) * 2 + (i & 1)), 0};	// half hits
+		memcpy(&keys[i * Len], key, Len);
+	}
+	size_t pos = 0;
+	size_t count = 0;
+	Perf().start();
+	for (auto _ : state) {
+		count += probe(&keys[pos * Len]);
+		pos = (pos + kWindowBatch) % kWindowKeys;
+	}
+	ReportPerf(state, Perf().stop(), state.iterations() * kWindowBatch);
+	benchmark::DoNotOptimize(count);
+	state.SetItemsProcessed(state.iterations() * kWindowBatch);
+	state.counters["bytes"] = static_cast<double>(bytes);
+	state.SetLabel(std::string("hash=") + pbf::HashName(pbf::DefaultHash()) + tag);
+}
+
+// Compile-time against runtime geometry on the same 4KB-page bitmap.
+// 256 pages index by mask, 250 pages by the constant divisor.
+template <unsigned PageNum>
+void ProbeFixed(benchmark::State& state, bool fixed) {
+	using Fixed = pbf::FixedPageBloomFilter<8, 12, PageNum>;
+	static Fixed fbf;	// static storage keeps the bitmap aligned
+	static std::unique_ptr<pbf::PageBloomFilter<8>> dbf;
+	if (dbf == nullptr) {
+		dbf.reset(new pbf::PageBloomFilter<8>(12, PageNum));
+		FillHalf<8>(fbf);
+		FillHalf<8>(*dbf);
+	}
+	RunWindow<8>(state, Fixed::capacity(), Fixed::data_size(), [&](const uint8_t* keys) {
+		size_t positive = 0;
+		for (size_t i = 0; i < kWindowBatch; i++) {
+			positive += fixed ? fbf.test(keys + i * 8, 8) : dbf->test(keys + i * 8, 8);
+		}
+		return positive;
+	}, fixed ? " fixed" : " runtime");
+}
+
+// The dynamic interface one key at a time through the vtable, against one
+// visit() per batch that probes the concrete filter.
+void ProbeVisit(benchmark::State& state, bool visit) {
+	static std::unique_ptr<pbf::BloomFilter> bf;
+	if (bf == nullptr) {
+		bf = pbf::New(8, 12, 64);
+		FillHalf<8>(*bf);
+	}
+	RunWindow<8>(state, bf->capacity(), bf->data_size(), [&](const uint8_t* keys) {
+		size_t positive = 0;
+		auto probe = [&](const auto& filter) {
+			for (size_t i = 0; i < kWindowBatch; i++) {
+				positive += filter.test(keys + i * 8, 8);
+			}
+		};
+		if (visit) {
+			const pbf::BloomFilter& ref = *bf;
+			ref.visit(probe);
+		} else {
+			probe(*bf);
+		}
+		return positive;
+	});
+}
+
+template <unsigned Len>
+size_t LibraryTest(const pbf::PageBloomFilter<8>& bf, const uint8_t* keys, size_t n) {
+	size_t positive = 0;
+	for (size_t i = 0; i < n; i++) {
+		positive += bf.test(keys + i * Len, Len);
+	}
+	return positive;
+}
+
+template <unsigned Len>
+size_t LibrarySet(pbf::PageBloomFilter<8>& bf, const uint8_t* keys, size_t n) {
+	size_t fresh = 0;
+	for (size_t i = 0; i < n; i++) {
+		fresh += bf.set(keys + i * Len, Len);
+	}
+	return fresh;
+}
+
+// Library calls against probes inlined by PBF_HEADER_ONLY, where the
+// constant key length reaches the hash, on an L2-sized filter.
+template <unsigned Len>
+void ProbeInline(benchmark::State& state, bool header, bool insert) {
+	static std::unique_ptr<pbf::PageBloomFilter<8>> bf;
+	if (bf == nullptr) {
+		bf.reset(new pbf::PageBloomFilter<8>(12, 64));
+		FillHalf<Len>(*bf);
+	}
+	RunWindow<Len>(state, bf->capacity(), bf->data_size(), [&](const uint8_t* batch) {
+		if (insert) {
+			return header ? HeaderOnlySet<Len>(*bf, batch, kWindowBatch)
+						  : LibrarySet<Len>(*bf, batch, kWindowBatch);
+		}
+		return header ? HeaderOnlyTest<Len>(*bf, batch, kWindowBatch)
+					  : LibraryTest<Len>(*bf, batch, kWindowBatch);
+	});
+}
+
+// Standard placement against TwoChoiceBloomFilter on the same bitmap size.
+// Tests run half full with half hits. Sets insert fresh keys from empty up to
+// 3/4 of capacity, then the filter is cleared outside the timed region.
+template <typename Filter>
+void ProbeChoice(benchmark::State& state, bool insert, unsigned page_level, size_t size) {
+	constexpr size_t kQueries = 1U << 16U;
+	constexpr size_t kBatch = 64;
+	static std::unique_ptr<Filter> bf;
+	if (bf == nullptr || bf->data_size() != size || bf->page_level() != page_level) {
+		bf.reset(new Filter(page_level, static_cast<unsigned>(size >> page_level)));
+	}
+	bf->clear();
+	const size_t half = bf->capacity() / 2;
+	std::vector<uint64_t> keys(kQueries);
+	for (size_t i = 0; i < kQueries; i++) {
+		keys[i] = Mix(i % half * 2 + (i & 1));	// half hits
+	}
+	if (!insert) {
+		for (uint64_t i = 0; i < half; i++) {
+			uint64_t key = Mix(i * 2);
+			bf->set(reinterpret_cast<const uint8_t*>(&key), 8);
+		}
+	}
+	size_t pos = 0;
+	size_t count = 0;
+	uint64_t next = 0;
+	Perf().start();
+	for (auto _ : state) {
+		if (insert) {
+			if (next >= bf->capacity() * 3 / 4) {
+				state.PauseTiming();
+				bf->clear();
+				next = 0;
+				state.ResumeTiming();
+			}
+			for (size_t i = 0; i < kBatch; i++) {
+				uint64_t key = Mix(next++);
+				count += bf->set(reinterpret_cast<const uint8_t*>(&key), 8);
+			}
+		} else {
+			for (size_t i = pos; i < pos + kBatch; i++) {
+				count += bf->test(reinterpret_cast<const uint8_t*>(&keys[i]), 8);
+			}
+			pos = (pos + kBatch) % kQueries;
+		}
+	}
+	ReportPerf(state, Perf().stop(), state.iterations() * kBatch);
+	benchmark::DoNotOptimize(count);
+	state.SetItemsProcessed(state.iterations() * kBatch);
+	state.counters["bytes"] = static_cast<double>(bf->data_size());
+	state.SetLabel(std::string("hash=") + pbf::HashName(pbf::DefaultHash()));
+}
+
+enum SetProbe : unsigned {
+	kSequential, kSetMask, kSetAny,
+};
+const char* const kSetProbeName[] = {"sequential", "mask", "any"};
+
+// One key against 8 runs of an LSM-like store, each filter 8MB.
+void ProbeSet(benchmark::State& state, SetProbe mode) {
+	constexpr unsigned kRuns = 8;
+	constexpr size_t kItems = size_t{1} << 22U;
+	static std::vector<std::unique_ptr<pbf::BloomFilter>> runs;
+	static pbf::FilterSet set;
+	constexpr size_t kQueries = 1U << 16U;
+	constexpr size_t kBatch = 64;
+	if (runs.empty()) {
+		for (unsigned r = 0; r < kRuns; r++) {
+			runs.push_back(pbf::New(8, 12, 2048, 0, nullptr, pbf::DefaultHash(), r));
+			for (uint64_t i = 0; i < kItems / kRuns; i++) {
+				uint64_t key = Mix((i * kRuns + r) * 2);
+				runs.back()->set(reinterpret_cast<const uint8_t*>(&key), 8);
+			}
+			set.add(*runs.back());
+		}
+	}
+	std::vector<uint64_t> keys(kQueries);
+	for (size_t i = 0; i < kQueries; i++) {
+		keys[i] = Mix(Mix(i) % kItems * 2 + (i & 1));	// half are in some run
+	}
+	size_t pos = 0;
+	size_t positive = 0;
+	Perf().start();
+	for (auto _ : state) {
+		for (size_t i = pos; i < pos + kBatch; i++) {
+			auto key = reinterpret_cast<const uint8_t*>(&keys[i]);
+			switch (mode) {
+				case kSequential:
+					for (auto& bf : runs) {
+						positive += bf->test(key, 8);
+					}
+					break;
+				case kSetMask:
+					positive += set.test(key, 8) != 0;
+					break;
+				case kSetAny:
+					positive += set.test_any(key, 8);
+					break;
+			}
+		}
+		pos = (pos + kBatch) % kQueries;
+	}
+	ReportPerf(state, Perf().stop(), state.iterations() * kBatch);
+	benchmark::DoNotOptimize(positive);
+	state.SetItemsProcessed(state.iterations() * kBatch);
+	state.counters["bytes"] = static_cast<double>(runs[0]->data_size() * kRuns);
+	state.SetLabel(std::string("hash=") + pbf::HashName(pbf::DefaultHash()));
+}
+
+enum StaticKind : unsigned {
+	kFuse8, kFuse16, kPageFuse8, kPageFuse16,
+};
+// Paged filters are planned for the FPR of the fuse filter they sit next to.
+const char* const kStaticKindName[] = {"fuse8", "fuse16", "pbf/fpr:fuse8", "pbf/fpr:fuse16"};
+
+// Immutable key set: binary fuse filters against paged bloom filters planned
+// for the same FPR. Reports memory per key and the FPR measured on strangers.
+void ProbeStatic(benchmark::State& state, StaticKind kind, size_t items) {
+	struct Entry {
+		std::unique_ptr<pbf::BinaryFuse8> fuse8;
+		std::unique_ptr<pbf::BinaryFuse16> fuse16;
+		std::unique_ptr<pbf::BloomFilter> page;
+		size_t bytes = 0;
+		double fpr = 0;
+		bool test(const uint8_t* key) const noexcept {
+			if (fuse8 != nullptr) return fuse8->test(key, 8);
+			if (fuse16 != nullptr) return fuse16->test(key, 8);
+			return page->test(key, 8);
+		}
+	};
+	static std::map<std::pair<unsigned, size_t>, Entry> cache;
+	constexpr size_t kQueries = 1U << 16U;
+	constexpr size_t kBatch = 64;
+	auto& e = cache[std::make_pair(static_cast<unsigned>(kind), items)];
+	if (e.bytes == 0) {
+		std::vector<uint64_t> members(items);
+		for (size_t i = 0; i < items; i++) {
+			members[i] = Mix(i * 2);
+		}
+		auto packed = reinterpret_cast<const uint8_t*>(members.data());
+		if (kind == kFuse8) {
+			e.fuse8.reset(new pbf::BinaryFuse8(packed, 8, items, 0));
+			e.bytes = e.fuse8->data_size();
+		} else if (kind == kFuse16) {
+			e.fuse16.reset(new pbf::BinaryFuse16(packed, 8, items, 0));
+			e.bytes = e.fuse16->data_size();
+		} else {
+			pbf::PlanRequest req;
+			req.item = items;
+			req.fpr = kind == kPageFuse8 ? 1.0f / 256 : 1.0f / 65536;
+			e.page = pbf::New(pbf::PlanFilter(req));
+			e.page->set_batch(packed, 8, items);
+			e.bytes = e.page->data_size();
+		}
+		size_t false_hits = 0;
+		constexpr size_t kStrangers = 1U << 22U;
+		for (size_t i = 0; i < kStrangers; i++) {
+			uint64_t key = Mix(i * 2 + 1);
+			false_hits += e.test(reinterpret_cast<const uint8_t*>(&key));
+		}
+		e.fpr = static_cast<double>(false_hits) / kStrangers;
+	}
+	std::vector<uint64_t> keys(kQueries);
+	for (size_t i = 0; i < kQueries; i++) {
+		keys[i] = Mix(Mix(i) % items * 2 + (i & 1));	// half hits
+	}
+	size_t pos = 0;
+	size_t positive = 0;
+	Perf().start();
+	for (auto _ : state) {
+		for (size_t i = pos; i < pos + kBatch; i++) {
+			positive += e.test(reinterpret_cast<const uint8_t*>(&keys[i]));
+		}
+		pos = (pos + kBatch) % kQueries;
+	}
+	ReportPerf(state, Perf().stop(), state.iterations() * kBatch);
+	benchmark::DoNotOptimize(positive);
+	state.SetItemsProcessed(state.iterations() * kBatch);
+	state.counters["bytes"] = static_cast<double>(e.bytes);
+	state.counters["bits_per_item"] = e.bytes * 8.0 / items;
+	state.counters["fpr"] = e.fpr;
+	state.SetLabel(std::string("hash=") + pbf::HashName(pbf::DefaultHash()));
+}
+
+// Binary fuse construction from a packed key array.
+void BuildStatic(benchmark::State& state, unsigned threads) {
+	constexpr size_t kItems = size_t{1} << 23U;
+	std::vector<uint64_t> members(kItems);
+	for (size_t i = 0; i < kItems; i++) {
+		members[i] = Mix(i * 2);
+	}
+	for (auto _ : state) {
+		pbf::BinaryFuse8 bf(reinterpret_cast<const uint8_t*>(members.data()), 8, kItems, threads);
+		benchmark::DoNotOptimize(bf.data());
+	}
+	state.SetItemsProcessed(state.iterations() * kItems);
+}
+
+enum AllocKind : unsigned {
+	kHeap, kPool,
+};
+const char* const kAllocKindName[] = {"new", "pool"};
+
+// Create/destroy churn of small per-session filters. A window of live filters
+// is recycled oldest first, so frees interleave with allocations as they do
+// when sessions come and go. Each new filter takes one insert.
+void Churn(benchmark::State& state, AllocKind kind, bool boxed, unsigned page_level, unsigned page_num) {
+	constexpr size_t kLive = 4096;
+	const auto hash = pbf::DefaultHash();
+	pbf::PoolMemoryResource pool(size_t{page_num} << page_level, 256);
+	auto resource = kind == kPool ? &pool : nullptr;
+	std::vector<std::unique_ptr<pbf::BloomFilter>> boxes(boxed ? kLive : 0);
+	std::vector<pbf::PageBloomFilter<6>> plain;
+	if (!boxed) {
+		for (size_t i = 0; i < kLive; i++) {
+			plain.emplace_back(0, 0);
+		}
+	}
+	uint64_t n = 0;
+	for (auto _ : state) {
+		auto slot = n % kLive;
+		auto key = reinterpret_cast<const uint8_t*>(&n);
+		if (boxed) {
+			boxes[slot] = pbf::New(6, page_level, page_num, 0, nullptr, hash, 0, resource);
+			boxes[slot]->set(key, 8);
+		} else {
+			plain[slot] = pbf::PageBloomFilter<6>(page_level, page_num, 0, nullptr, hash, 0, resource);
+			plain[slot].set(key, 8);
+		}
+		n++;
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["bytes"] = static_cast<double>(size_t{page_num} << page_level);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Empty-filter setup and clear() of a large filter, with global new versus
+// lazily mapped zero pages. Each clear follows 4096 untimed inserts.
+void Lazy(benchmark::State& state, bool mapped, bool clear, unsigned page_num) {
+	constexpr unsigned kPageLevel = 12;
+	pbf::MappedMemoryResource lazy;
+	auto resource = mapped ? &lazy : nullptr;
+	pbf::PageBloomFilter<8> bf(kPageLevel, clear ? page_num : 1, 0, nullptr, pbf::DefaultHash(), 0, resource);
+	uint64_t n = 0;
+	for (auto _ : state) {
+		if (!clear) {
+			pbf::PageBloomFilter<8> fresh(kPageLevel, page_num, 0, nullptr, pbf::DefaultHash(), 0, resource);
+			fresh.set(reinterpret_cast<const uint8_t*>(&n), 8);
+			n++;
+			continue;
+		}
+		state.PauseTiming();
+		for (unsigned i = 0; i < 4096; i++, n++) {
+			bf.set(reinterpret_cast<const uint8_t*>(&n), 8);
+		}
+		state.ResumeTiming();
+		bf.clear();
+	}
+	state.counters["bytes"] = static_cast<double>(size_t{page_num} << kPageLevel);
+}
+#endif
+
+// Pin the calling thread to the index-th CPU it may run on, wrapping around.
+void PinThread(int index) {
+#if defined(__linux__)
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+		return;
+	}
+	int target = index % CPU_COUNT(&allowed);
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+			cpu_set_t one;
+			CPU_ZERO(&one);
+			CPU_SET(cpu, &one);
+			pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+			return;
+		}
+	}
+#else
+	(void)index;
+#endif
+}
+
+struct ScaleConfig {
+	size_t size;
+	unsigned write_percent;	// 0 for read-only
+	bool batch;
+};
+
+// Filters shared by all threads of a scaling run, half full. Reads go to a
+// PageBloomFilter, writes need the atomic SharedBloomFilter.
+const pbf::PageBloomFilter<8>& ScaleReader(size_t size) {
+	static std::mutex lock;
+	static std::map<size_t, std::unique_ptr<pbf::PageBloomFilter<8>>> filters;
+	std::lock_guard<std::mutex> guard(lock);
+	auto& bf = filters[size];
+	if (bf == nullptr) {
+		bf.reset(new pbf::PageBloomFilter<8>(12, static_cast<unsigned>(size >> 12U)));
+		for (uint64_t i = 0; i < bf->capacity() / 2; i++) {
+			uint64_t key = Mix(i * 2);
+			bf->set(reinterpret_cast<const uint8_t*>(&key), 8);
+		}
+	}
+	return *bf;
+}
+
+#ifdef PBF_GBENCH_SHM
+void HalfFill(pbf::SharedBloomFilter& bf) {
+	bf.clear();
+	for (uint64_t i = 0; i < bf.data_size() / 2; i++) {
+		uint64_t key = Mix(i * 2);
+		bf.set(reinterpret_cast<const uint8_t*>(&key), 8);
+	}
+}
+
+// nullptr when shared memory is unavailable.
+pbf::SharedBloomFilter* ScaleWriter(size_t size) {
+	static std::mutex lock;
+	static std::map<size_t, std::unique_ptr<pbf::SharedBloomFilter>> filters;
+	std::lock_guard<std::mutex> guard(lock);
+	auto& bf = filters[size];
+	if (bf == nullptr) {
+		bf = pbf::CreateSharedBloomFilter(nullptr, 8, 12, static_cast<unsigned>(size >> 12U));
+		if (bf != nullptr) {
+			HalfFill(*bf);
+		}
+	}
+	return bf.get();
+}
+#endif
+
+// Aggregate throughput of N pinned threads on one filter. Ops are reported as
+// a rate over wall time, summed over threads. DRAM traffic is estimated from
+// LLC misses when perf events are available. Otherwise touched_bytes gives the
+// cache lines a probe reads, an upper bound that a DRAM-bound run approaches.
+void Scale(benchmark::State& state, ScaleConfig cfg) {
+	constexpr size_t kQueries = 1U << 16U;
+	constexpr size_t kBatch = 64;
+	PinThread(state.thread_index());
+	const auto& reader = ScaleReader(cfg.size);
+#ifdef PBF_GBENCH_SHM
+	pbf::SharedBloomFilter* writer = nullptr;
+	if (cfg.write_percent != 0) {
+		writer = ScaleWriter(cfg.size);
+		if (writer == nullptr) {
+			state.SkipWithError("shared memory unavailable");
+			return;
+		}
+		// Inserts of new keys drift the fill up; once past 60%, thread 0 starts
+		// over while the others wait at the loop.
+		if (state.thread_index() == 0 && writer->unique_cnt() > writer->data_size() * 3 / 5) {
+			HalfFill(*writer);
+		}
+	}
+#endif
+	const uint64_t half = reader.capacity() / 2;
+	std::vector<uint64_t> keys(kQueries);
+	for (size_t i = 0; i < kQueries; i++) {
+		keys[i] = Mix((i * 7919 + static_cast<size_t>(state.thread_index()) * 104729) % half * 2 + (i & 1));
+	}
+	uint64_t fresh = (static_cast<uint64_t>(state.thread_index()) + 1) << 40U;
+	bool out[kBatch];
+	size_t pos = 0;
+	size_t positive = 0;
+	thread_local PerfCounters perf;
+	perf.start();
+	for (auto _ : state) {
+		auto batch = reinterpret_cast<const uint8_t*>(&keys[pos]);
+		if (cfg.write_percent != 0) {
+#ifdef PBF_GBENCH_SHM
+			for (size_t i = 0; i < kBatch; i++) {
+				if ((pos + i) % 100 < cfg.write_percent) {
+					uint64_t key = Mix(fresh++);
+					writer->set(reinterpret_cast<const uint8_t*>(&key), 8);
+				} else {
+					positive += writer->test(batch + i * 8, 8);
+				}
+			}
+#endif
+		} else if (cfg.batch) {
+			reader.test_batch(batch, 8, kBatch, out);
+			positive += out[0];
+		} else {
+			for (size_t i = 0; i < kBatch; i++) {
+				positive += reader.test(batch + i * 8, 8);
+			}
+		}
+		pos = (pos + kBatch) % kQueries;
+	}
+	auto sample = perf.stop();
+	benchmark::DoNotOptimize(positive);
+	const double ops = static_cast<double>(state.iterations() * kBatch);
+	state.SetItemsProcessed(state.iterations() * kBatch);
+	if (sample.value[PerfCounters::kLLCMiss] >= 0) {
+		state.counters["dram_bytes"] = benchmark::Counter(sample.value[PerfCounters::kLLCMiss] * 64,
+														  benchmark::Counter::kIsRate);
+	}
+	// Distinct lines of a 4 KiB page hit by 8 probes: 64 * (1 - (63/64)^8).
+	state.counters["touched_bytes"] = benchmark::Counter(ops * 64 * (1 - std::pow(63.0 / 64.0, 8)) * 64,
+														 benchmark::Counter::kIsRate);
+	state.counters["bytes"] = static_cast<double>(cfg.size);
+	state.SetLabel(std::string("hash=") + pbf::HashName(pbf::DefaultHash()));
+}
+
+bool Valid(const Config& cfg) {
+	if (cfg.page_level < (8 - 8 / cfg.way) || cfg.page_level > 13 || cfg.size > g_max_size
+		|| !pbf::HashAvailable(cfg.hash)) {
+		return false;
+	}
+	size_t page_num = cfg.size >> cfg.page_level;
+	return page_num != 0 && page_num < pbf::kMaxPageNum;
+}
+
+std::string Name(const char* op, const Config& cfg) {
+	return std::string(op) + "/way:" + std::to_string(cfg.way)
+		   + "/page_level:" + std::to_string(cfg.page_level)
+		   + "/size:" + std::to_string(cfg.size)
+		   + "/key:" + kKeyShapeName[cfg.shape]
+		   + (cfg.random ? "/random" : "/sequential")
+		   + "/hit:" + std::to_string(cfg.hit_percent)
+		   + (cfg.batch ? "/batch" : "/single")
+		   + "/hash:" + pbf::HashName(cfg.hash);
+}
+
+void Register(const Config& cfg) {
+	if (!Valid(cfg)) {
+		return;
+	}
+	benchmark::RegisterBenchmark(Name("test", cfg).c_str(), Probe, cfg);
+	if (cfg.hit_percent == 50) {
+		benchmark::RegisterBenchmark(Name("set", cfg).c_str(), Insert, cfg);
+	}
+}
+
+void RegisterAll() {
+	// From L1-resident up to far beyond LLC.
+	const size_t sizes[] = {
+		size_t{32} << 10, size_t{256} << 10, size_t{2} << 20, size_t{16} << 20,
+		size_t{128} << 20, size_t{1} << 30, size_t{4} << 30,
+	};
+	const unsigned levels[] = {6, 7, 9, 11, 12, 13};
+	const auto hash = pbf::DefaultHash();
+
+	// Geometry sweep with the common key shape.
+	for (unsigned way = 4; way <= 8; way++) {
+		for (auto level : levels) {
+			for (auto size : sizes) {
+				for (bool batch : {false, true}) {
+					Register({way, level, size, kFixed8, true, 50, batch, hash});
+				}
+			}
+		}
+	}
+	// Key shape, order and hit ratio sweep on a cache-resident and a DRAM-bound filter.
+	for (auto size : {size_t{1} << 20, size_t{128} << 20}) {
+		for (unsigned shape = kFixed8; shape <= kVariable; shape++) {
+			for (bool random : {false, true}) {
+				for (unsigned hit : {0U, 50U, 100U}) {
+					for (bool batch : {false, true}) {
+						if (shape == kFixed8 && random && hit == 50) {
+							continue;	// already covered above
+						}
+						Register({8, 12, size, static_cast<KeyShape>(shape), random, hit, batch, hash});
+					}
+				}
+			}
+		}
+	}
+	for (bool fixed : {true, false}) {
+		const char* kind = fixed ? "fixed" : "runtime";
+		benchmark::RegisterBenchmark((std::string("geometry/") + kind + "/way:8/page_level:12/pages:256").c_str(),
+									 ProbeFixed<256>, fixed);
+		benchmark::RegisterBenchmark((std::string("geometry/") + kind + "/way:8/page_level:12/pages:250").c_str(),
+									 ProbeFixed<250>, fixed);
+	}
+	for (bool visit : {false, true}) {
+		benchmark::RegisterBenchmark((std::string("dispatch/") + (visit ? "visit" : "virtual")
+									  + "/way:8/page_level:12/pages:64").c_str(), ProbeVisit, visit);
+	}
+	for (bool insert : {false, true}) {
+		for (bool header : {false, true}) {
+			auto name = std::string("inline/") + (header ? "header" : "library") + (insert ? "/set" : "/test");
+			benchmark::RegisterBenchmark((name + "/key:8/way:8/page_level:12/pages:64").c_str(),
+										 ProbeInline<8>, header, insert);
+			benchmark::RegisterBenchmark((name + "/key:16/way:8/page_level:12/pages:64").c_str(),
+										 ProbeInline<16>, header, insert);
+		}
+	}
+	for (size_t size : {size_t{256} << 10, size_t{64} << 20}) {
+		if (size > g_max_size) {
+			continue;
+		}
+		for (unsigned level : {7U, 12U}) {
+			if ((size >> level) >= pbf::kMaxPageNum) {
+				continue;
+			}
+			for (bool insert : {false, true}) {
+				auto suffix = std::string(insert ? "/set" : "/test") + "/way:8/page_level:" + std::to_string(level)
+							  + "/size:" + std::to_string(size);
+				benchmark::RegisterBenchmark(("choice/standard" + suffix).c_str(),
+											 ProbeChoice<pbf::PageBloomFilter<8>>, insert, level, size);
+				benchmark::RegisterBenchmark(("choice/two" + suffix).c_str(),
+											 ProbeChoice<pbf::TwoChoiceBloomFilter<8>>, insert, level, size);
+			}
+		}
+	}
+	std::vector<int> thread_counts;
+	const int cpus = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U));
+	for (int t = 1; t < cpus; t *= 2) {
+		thread_counts.push_back(t);
+	}
+	thread_counts.push_back(cpus);
+	for (auto size : {size_t{2} << 20, size_t{256} << 20}) {
+		if (size > g_max_size) {
+			continue;
+		}
+		for (unsigned write : {0U, 10U, 50U}) {
+			for (bool batch : {false, true}) {
+#ifndef PBF_GBENCH_SHM
+				if (write != 0) continue;
+#endif
+				if (write != 0 && batch) {
+					continue;	// no thread-safe batch insert
+				}
+				auto name = std::string("scale/") + (write == 0 ? "read" : "write:" + std::to_string(write))
+							+ (batch ? "/batch" : "/single") + "/way:8/page_level:12/size:" + std::to_string(size);
+				auto b = benchmark::RegisterBenchmark(name.c_str(), Scale, ScaleConfig{size, write, batch});
+				for (auto t : thread_counts) {
+					b->Threads(t);
+				}
+				b->UseRealTime();
+			}
+		}
+	}
+	for (unsigned mode = kSequential; mode <= kSetAny; mode++) {
+		benchmark::RegisterBenchmark((std::string("filter_set/") + kSetProbeName[mode] + "/runs:8/size:8388608").c_str(),
+									 ProbeSet, static_cast<SetProbe>(mode));
+	}
+	for (auto items : {size_t{1} << 20U, size_t{1} << 24U}) {
+		for (unsigned kind = kFuse8; kind <= kPageFuse16; kind++) {
+			benchmark::RegisterBenchmark((std::string("static/") + kStaticKindName[kind]
+										  + "/items:" + std::to_string(items)).c_str(),
+										 ProbeStatic, static_cast<StaticKind>(kind), items);
+		}
+	}
+	for (unsigned threads : {1U, 0U}) {
+		benchmark::RegisterBenchmark((std::string("static_build/fuse8/items:8388608/threads:")
+									  + (threads == 0 ? "all" : "1")).c_str(), BuildStatic, threads)
+				->Unit(benchmark::kMillisecond);
+	}
+	const std::pair<unsigned, unsigned> small_geometries[] = {{7, 4}, {10, 4}, {12, 16}};
+	for (auto geometry : small_geometries) {
+		for (unsigned kind = kHeap; kind <= kPool; kind++) {
+			for (bool boxed : {false, true}) {
+				benchmark::RegisterBenchmark((std::string("churn/") + kAllocKindName[kind]
+											  + (boxed ? "/boxed" : "/plain") + "/bytes:"
+											  + std::to_string(size_t{geometry.second} << geometry.first)).c_str(),
+											 Churn, static_cast<AllocKind>(kind), boxed,
+											 geometry.first, geometry.second);
+			}
+		}
+	}
+#if defined(__unix__) || defined(__APPLE__)
+	for (unsigned page_num : {4096U, 65536U}) {
+		for (bool mapped : {false, true}) {
+			for (bool clear : {false, true}) {
+				benchmark::RegisterBenchmark((std::string("lazy/") + (mapped ? "mapped" : "new")
+											  + (clear ? "/clear" : "/create") + "/bytes:"
+											  + std::to_string(size_t{page_num} << 12U)).c_str(),
+											 Lazy, mapped, clear, page_num)
+						->Unit(benchmark::kMicrosecond);
+			}
+		}
+	}
+#endif
+	// Hash backends available on this host, across key lengths.
+	const pbf::HashId hashes[] = {
+		pbf::HashId::kSpooky, pbf::HashId::kXXH3, pbf::HashId::kAESNI, pbf::HashId::kCRC32C,
+	};
+	for (auto other : hashes) {
+		if (other == hash) {
+			continue;	// already covered above
+		}
+		for (auto size : {size_t{1} << 20, size_t{128} << 20}) {
+			for (unsigned shape = kFixed8; shape <= kVariable; shape++) {
+				for (bool batch : {false, true}) {
+					Register({8, 12, size, static_cast<KeyShape>(shape), true, 50, batch, other});
+				}
+			}
+		}
+	}
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	std::vector<char*> args;
+	bool has_format = false;
+	for (int i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "--max_size=", 11) == 0) {
+			g_max_size = std::stoull(argv[i] + 11);
+			continue;
+		}
+		if (strncmp(argv[i], "--benchmark_format=", 19) == 0) {
+			has_format = true;
+		}
+		args.push_back(argv[i]);
+	}
+	static char json[] = "--benchmark_format=json";
+	if (!has_format) {
+		args.push_back(json);
+	}
+	int n = static_cast<int>(args.size());
+	args.push_back(nullptr);
+
+	RegisterAll();
+	benchmark::Initialize(&n, args.data());
+	if (benchmark::ReportUnrecognizedArguments(n, args.data())) {
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
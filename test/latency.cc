@@ -0,0 +1,262 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Probe latency distribution against filter size.
+//
+// Filters from 32KB up to --max-size, doubling each step and ending at
+// --max-size itself, are half filled, then probed with random keys, half of
+// them members. A filter holds fewer than kMaxPageNum (2^18) pages, so a page
+// level reaches at most (2^18-1) << level bytes: just under 32MB at level 7
+// and 1GB at level 12. When --max-size is beyond that, the last step of the
+// level measures this largest size and a comment line notes the cut. Probes
+// are timed in groups of --group with the cycle counter, which keeps timer
+// overhead small, and every group records its mean per-probe latency. The
+// percentiles therefore describe groups: a lone slow probe is diluted by its
+// neighbours. With --group=1 each probe is timed alone, timer cost included.
+// Every size runs once per page level and once per allocation policy: global
+// new, and on Linux, transparent huge pages through a MemoryResource.
+//
+// usage: pbf-latency [--max-size=BYTES] [--probes=N] [--group=N] [--levels=L,L,...]
+//                    [--hash=spooky|xxh3|aesni|crc32c]
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include "pbf.h"
+#if defined(_M_X64) || defined(__x86_64__) || defined(__amd64__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define LATENCY_TSC 1
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+struct Options {
+	size_t max_size = size_t{1} << 30;
+	size_t probes = 1000000;
+	unsigned group = 8;
+	std::vector<unsigned> levels = {7, 9, 12};
+	pbf::HashId hash = pbf::DefaultHash();
+} g_opt;
+
+uint64_t Mix(uint64_t x) noexcept {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27U)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31U);
+}
+
+inline uint64_t Ticks() noexcept {
+#if defined(LATENCY_TSC)
+	_mm_lfence();
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t v;
+	asm volatile("isb; mrs %0, cntvct_el0" : "=r"(v));
+	return v;
+#else
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+#if defined(__linux__)
+// Anonymous mappings aligned to 2MB and advised for transparent huge pages.
+class HugePageResource final : public pbf::MemoryResource {
+public:
+	static constexpr size_t kHugePage = size_t{2} << 20;
+
+	void* allocate(size_t size, size_t) noexcept override {
+		size = RoundUp(size);
+		void* addr = mmap(nullptr, size + kHugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr == MAP_FAILED) {
+			return nullptr;
+		}
+		auto raw = reinterpret_cast<uintptr_t>(addr);
+		auto aligned = (raw + kHugePage - 1) & ~(kHugePage - 1);
+		if (aligned != raw) {
+			munmap(addr, aligned - raw);
+		}
+		munmap(reinterpret_cast<void*>(aligned + size), raw + kHugePage - aligned);
+		madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+		return reinterpret_cast<void*>(aligned);
+	}
+	void deallocate(void* p, size_t size, size_t) noexcept override {
+		munmap(p, RoundUp(size));
+	}
+
+private:
+	static size_t RoundUp(size_t size) noexcept {
+		return (size + kHugePage - 1) & ~(kHugePage - 1);
+	}
+};
+#endif
+
+struct Policy {
+	const char* name;
+	pbf::MemoryResource* resource;
+};
+
+struct Clock {
+	uint64_t ticks = Ticks();
+	std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+
+	double ticks_per_ns() const {
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - time).count();
+		return ns > 0 ? static_cast<double>(Ticks() - ticks) / static_cast<double>(ns) : 1.0;
+	}
+};
+
+// One row: fill, probe, and print percentiles in ns.
+void Run(const Policy& policy, unsigned level, size_t size, const Clock& clock) {
+	const auto page_num = static_cast<unsigned>(size >> level);
+	pbf::PageBloomFilter<8> bf(level, page_num, 0, nullptr, g_opt.hash, 0, policy.resource);
+	if (!bf) {
+		std::cerr << policy.name << ": cannot allocate " << size << " bytes" << std::endl;
+		return;
+	}
+	const size_t members = bf.capacity() / 2;
+	std::vector<uint64_t> keys(4096);
+	for (size_t i = 0; i < members; i += keys.size()) {
+		size_t n = std::min(keys.size(), members - i);
+		for (size_t j = 0; j < n; j++) {
+			keys[j] = Mix((i + j) * 2);
+		}
+		bf.set_batch(reinterpret_cast<const uint8_t*>(keys.data()), 8, n);
+	}
+
+	const size_t groups = std::max<size_t>(g_opt.probes / g_opt.group, 1);
+	keys.resize(groups * g_opt.group);
+	for (size_t i = 0; i < keys.size(); i++) {
+		uint64_t id = Mix(i ^ size) % members;
+		keys[i] = Mix(id * 2 + (i & 1));	// half members
+	}
+	size_t positive = 0;
+	for (size_t i = 0; i < std::min<size_t>(keys.size(), 65536); i++) {	// warm up
+		positive += bf.test(reinterpret_cast<const uint8_t*>(&keys[i]), 8);
+	}
+	positive = 0;
+	std::vector<double> samples(groups);
+	auto key = reinterpret_cast<const uint8_t*>(keys.data());
+	for (size_t g = 0; g < groups; g++) {
+		auto start = Ticks();
+		for (unsigned j = 0; j < g_opt.group; j++) {
+			positive += bf.test(key, 8);
+			key += 8;
+		}
+		samples[g] = static_cast<double>(Ticks() - start) / g_opt.group;
+	}
+	if (positive < keys.size() / 2) {
+		std::cerr << "lost members" << std::endl;
+	}
+
+	const double scale = 1.0 / clock.ticks_per_ns();
+	double mean = 0;
+	for (auto v : samples) {
+		mean += v;
+	}
+	mean /= static_cast<double>(groups);
+	std::sort(samples.begin(), samples.end());
+	auto at = [&](double q) {
+		return samples[std::min(groups - 1, static_cast<size_t>(q * static_cast<double>(groups)))] * scale;
+	};
+	std::cout << policy.name << '\t' << level << '\t' << size << '\t' << std::fixed << std::setprecision(1)
+			  << mean * scale << '\t' << at(0.5) << '\t' << at(0.9) << '\t' << at(0.99) << '\t'
+			  << at(0.999) << '\t' << samples.back() * scale << std::endl;
+}
+
+bool ParseHash(const std::string& name, pbf::HashId& out) {
+	const pbf::HashId ids[] = {
+		pbf::HashId::kSpooky, pbf::HashId::kXXH3, pbf::HashId::kAESNI, pbf::HashId::kCRC32C,
+	};
+	for (auto id : ids) {
+		if (name == pbf::HashName(id)) {
+			out = id;
+			return pbf::HashAvailable(id);
+		}
+	}
+	return false;
+}
+
+bool ParseLevels(const std::string& list, std::vector<unsigned>& out) {
+	out.clear();
+	std::istringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ',')) {
+		auto level = std::stoul(item);
+		if (level < 7 || level > 13) {
+			return false;
+		}
+		out.push_back(static_cast<unsigned>(level));
+	}
+	return !out.empty();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 11, "--max-size=") == 0) {
+			g_opt.max_size = std::stoull(arg.substr(11));
+		} else if (arg.compare(0, 9, "--probes=") == 0) {
+			g_opt.probes = std::max(std::stoull(arg.substr(9)), 1ULL);
+		} else if (arg.compare(0, 8, "--group=") == 0) {
+			g_opt.group = static_cast<unsigned>(std::max(std::stoul(arg.substr(8)), 1UL));
+		} else if (arg.compare(0, 9, "--levels=") == 0 && ParseLevels(arg.substr(9), g_opt.levels)) {
+		} else if (arg.compare(0, 7, "--hash=") == 0) {
+			if (!ParseHash(arg.substr(7), g_opt.hash)) {
+				std::cerr << "hash " << arg.substr(7) << " is not available" << std::endl;
+				return 1;
+			}
+		} else {
+			std::cerr << "usage: " << argv[0] << " [--max-size=BYTES] [--probes=N] [--group=N]"
+					  << " [--levels=L,L,...] [--hash=NAME]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<Policy> policies = {{"new", nullptr}};
+#if defined(__linux__)
+	HugePageResource huge;
+	policies.push_back({"thp", &huge});
+#endif
+	Clock clock;
+	std::cout << "# way 8, half full, random keys with 50% hits, hash " << pbf::HashName(g_opt.hash) << '\n'
+			  << "# ns per probe over groups of " << g_opt.group << " probes\n"
+			  << "alloc\tlevel\tbytes\tmean\tp50\tp90\tp99\tp999\tmax\n";
+	for (auto level : g_opt.levels) {
+		for (auto& policy : policies) {
+			const size_t limit = static_cast<size_t>(pbf::kMaxPageNum - 1) << level;
+			const size_t top = std::min(g_opt.max_size, limit);
+			for (size_t step = size_t{32} << 10; ; step *= 2) {
+				auto size = std::min(step, top);
+				if ((size >> level) != 0) {
+					Run(policy, level, size, clock);
+				}
+				if (step >= top) {
+					break;
+				}
+			}
+			if (g_opt.max_size > limit) {
+				std::cout << "# " << policy.name << '\t' << level << "\tsizes above " << limit
+						  << " skipped, the page limit is " << pbf::kMaxPageNum - 1 << '\n';
+			}
+		}
+	}
+	return 0;
+}
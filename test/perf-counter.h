@@ -0,0 +1,136 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+// Optional hardware counters for benchmarks via perf_event_open. Every event
+// is opened on its own, so a host exposing only some of them still reports
+// those; in containers or on non-Linux hosts nothing is available and the
+// benchmarks print timing only. Set PBF_PERF=0 to disable the counters.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+class PerfCounters final {
+public:
+	enum Event : unsigned {
+		kCycles, kInstructions, kL1DMiss, kLLCMiss, kDTLBMiss, kBranchMiss, kEventNum
+	};
+
+	static const char* Name(unsigned e) noexcept {
+		static const char* const names[kEventNum] = {
+			"cycles", "instructions", "l1d-miss", "llc-miss", "dtlb-miss", "branch-miss",
+		};
+		return names[e];
+	}
+
+	struct Sample {
+		double value[kEventNum];	// negative when unavailable
+	};
+
+	PerfCounters() {
+		for (auto& fd : m_fd) fd = -1;
+#if defined(__linux__)
+		auto env = getenv("PBF_PERF");
+		if (env != nullptr && strcmp(env, "0") == 0) {
+			return;
+		}
+		auto cache = [](uint64_t id, uint64_t op, uint64_t result) {
+			return id | (op << 8U) | (result << 16U);
+		};
+		const struct { uint32_t type; uint64_t config; } events[kEventNum] = {
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+			{PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+									   PERF_COUNT_HW_CACHE_RESULT_MISS)},
+			{PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+									   PERF_COUNT_HW_CACHE_RESULT_MISS)},
+			{PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+									   PERF_COUNT_HW_CACHE_RESULT_MISS)},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		};
+		for (unsigned i = 0; i < kEventNum; i++) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = events[i].type;
+			attr.config = events[i].config;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			m_fd[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+		}
+#endif
+	}
+
+	~PerfCounters() {
+#if defined(__linux__)
+		for (auto fd : m_fd) {
+			if (fd >= 0) close(fd);
+		}
+#endif
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool available() const noexcept {
+		for (auto fd : m_fd) {
+			if (fd >= 0) return true;
+		}
+		return false;
+	}
+
+	void start() noexcept {
+#if defined(__linux__)
+		for (auto fd : m_fd) {
+			if (fd < 0) continue;
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	// Stop counting and return totals, scaled when events were multiplexed.
+	Sample stop() noexcept {
+		Sample out;
+		for (unsigned i = 0; i < kEventNum; i++) {
+			out.value[i] = -1;
+#if defined(__linux__)
+			if (m_fd[i] < 0) continue;
+			ioctl(m_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+			uint64_t buf[3];	// value, time_enabled, time_running
+			if (read(m_fd[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) continue;
+			out.value[i] = static_cast<double>(buf[0]) * buf[1] / buf[2];
+#endif
+		}
+		return out;
+	}
+
+	// "cycles=12.3 instructions=45.6 ..." per operation, or "" when unavailable.
+	static std::string Format(const Sample& sample, double ops) {
+		std::ostringstream out;
+		for (unsigned i = 0; i < kEventNum; i++) {
+			if (sample.value[i] < 0) continue;
+			out << (out.tellp() > 0 ? " " : "") << Name(i) << '=' << sample.value[i] / ops;
+		}
+		if (sample.value[kCycles] > 0 && sample.value[kInstructions] >= 0) {
+			out << " ipc=" << sample.value[kInstructions] / sample.value[kCycles];
+		}
+		return out.str();
+	}
+
+private:
+	int m_fd[kEventNum];
+};
@@ -0,0 +1,55 @@
+// Copyright (c) 2023, Ruan Kunliang.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Built with PBF_HEADER_ONLY: the probes below are compiled into this file and
+// must match the library's bit for bit.
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include "pbf.h"
+
+namespace {
+
+template <unsigned N>
+void CheckHeaderOnly(unsigned page_level, unsigned page_num, pbf::HashId hash, uint64_t seed) {
+	pbf::PageBloomFilter<N> local(page_level, page_num, 0, nullptr, hash, seed);
+	auto lib = pbf::New(N, page_level, page_num, 0, nullptr, hash, seed);
+	ASSERT_FALSE(!local);
+	ASSERT_FALSE(!lib);
+	for (uint64_t i = 0; i < 2000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		ASSERT_EQ(lib->set(key, 8), local.set(key, 8));
+	}
+	std::string text;
+	for (unsigned len = 0; len < 80; len++) {
+		ASSERT_EQ(lib->set(reinterpret_cast<const uint8_t*>(text.data()), len),
+				  local.set(reinterpret_cast<const uint8_t*>(text.data()), len));
+		text.push_back(static_cast<char>('a' + len % 26));
+	}
+	ASSERT_EQ(lib->unique_cnt(), local.unique_cnt());
+	ASSERT_EQ(0, memcmp(lib->data(), local.data(), local.data_size()));
+	for (uint64_t i = 0; i < 4000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		ASSERT_EQ(lib->test(key, 8), local.test(key, 8));
+	}
+	ASSERT_FALSE(local.test(nullptr, 1));
+	ASSERT_FALSE(local.set(nullptr, 1));
+}
+
+} // namespace
+
+TEST(PBF, HeaderOnly) {
+	CheckHeaderOnly<8>(12, 37, pbf::DefaultHash(), 0);
+	CheckHeaderOnly<5>(9, 64, pbf::DefaultHash(), 0x5eedULL);
+	CheckHeaderOnly<4>(6, 3, pbf::HashId::kCRC32C, 7);	// through the hash pointer
+
+	static pbf::FixedPageBloomFilter<6, 8, 37> fixed;
+	auto lib = pbf::New(6, 8, 37);
+	for (uint64_t i = 0; i < 1000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		ASSERT_EQ(lib->set(key, 8), fixed.set(key, 8));
+	}
+	ASSERT_EQ(0, memcmp(lib->data(), fixed.data(), fixed.data_size()));
+}
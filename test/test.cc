@@ -6,8 +6,22 @@
 #include <algorithm>
 #include <string>
 #include <vector>
+#include <cstring>
 #include "pbf.h"
 #include "pbf-c.h"
+#ifndef _WIN32
+#include <cstdio>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "pbf-disk.h"
+#include "pbf-shm.h"
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 int main(int argc,char **argv){
 	testing::InitGoogleTest(&argc,argv);
@@ -165,6 +179,150 @@ TEST(PBF, KeyLengthAndAlignmentBoundaries) {
 	CheckKeyBoundaries<8>();
 }
 
+static void CheckHandle(unsigned way, unsigned page_level, unsigned page_num, uint64_t seed) {
+	auto ref = pbf::New(way, page_level, page_num, 0, nullptr, pbf::DefaultHash(), seed);
+	ASSERT_NE(nullptr, ref);
+	auto bf = pbf_create(way, page_level, page_num, seed);
+	ASSERT_NE(nullptr, bf);
+	ASSERT_EQ(pbf_data_size(bf), ref->data_size());
+
+	constexpr size_t n = 301;
+	std::vector<uint64_t> keys(n * 2);
+	for (size_t i = 0; i < keys.size(); i++) {
+		keys[i] = i * 0x9e3779b97f4a7c15ULL;
+	}
+	std::vector<const void*> ptrs(n);
+	std::vector<unsigned> lens(n);
+	std::vector<size_t> offsets(n + 1);
+	for (size_t i = 0; i < n; i++) {
+		ptrs[i] = &keys[i];
+		lens[i] = 1 + i % 8;
+		offsets[i+1] = offsets[i] + lens[i];
+	}
+	std::vector<uint8_t> bitmap((n + 7) / 8, 0xff);
+	size_t added = pbf_set_batch(bf, ptrs.data(), lens.data(), n, bitmap.data());
+	size_t expect = 0;
+	for (size_t i = 0; i < n; i++) {
+		bool fresh = ref->set(static_cast<const uint8_t*>(ptrs[i]), lens[i]);
+		expect += fresh;
+		ASSERT_EQ(fresh, ((bitmap[i/8] >> (i%8)) & 1U) != 0);
+	}
+	EXPECT_EQ(bitmap.back() >> (n % 8), 0);
+	EXPECT_EQ(added, expect);
+	EXPECT_EQ(pbf_unique_cnt(bf), expect);
+	EXPECT_EQ(0, memcmp(pbf_data(bf), ref->data(), ref->data_size()));
+
+	auto strip = reinterpret_cast<const uint8_t*>(keys.data() + n);
+	added = pbf_set_strided(bf, strip, 8, n, nullptr);
+	EXPECT_EQ(added, ref->set_batch(strip, 8, n));
+	EXPECT_EQ(0, memcmp(pbf_data(bf), ref->data(), ref->data_size()));
+
+	auto checked = [&](const char* what) {
+		for (size_t i = 0; i < n; i++) {
+			bool hit = ref->test(reinterpret_cast<const uint8_t*>(keys.data()) + offsets[i], lens[i]);
+			ASSERT_EQ(hit, ((bitmap[i/8] >> (i%8)) & 1U) != 0) << what << " key " << i;
+		}
+	};
+	pbf_test_offsets(bf, keys.data(), offsets.data(), n, bitmap.data());
+	checked("offsets");
+	auto copy = pbf_restore(way, page_level, page_num, seed, pbf_data(bf), pbf_unique_cnt(bf));
+	ASSERT_NE(nullptr, copy);
+	EXPECT_EQ(pbf_unique_cnt(copy), pbf_unique_cnt(bf));
+	std::fill(bitmap.begin(), bitmap.end(), 0xff);
+	pbf_set_offsets(copy, keys.data(), offsets.data(), n, bitmap.data());
+	pbf_test_offsets(copy, keys.data(), offsets.data(), n, bitmap.data());
+	for (size_t i = 0; i < n; i++) {
+		ASSERT_TRUE((bitmap[i/8] >> (i%8)) & 1U);
+	}
+	EXPECT_EQ(bitmap.back() >> (n % 8), 0);
+	pbf_free(copy);
+
+	pbf_test_strided(bf, strip, 8, n, bitmap.data());
+	for (size_t i = 0; i < n; i++) {
+		ASSERT_TRUE((bitmap[i/8] >> (i%8)) & 1U);
+		ASSERT_TRUE(pbf_test(bf, strip + i * 8, 8));
+	}
+	pbf_test_batch(bf, ptrs.data(), lens.data(), n, bitmap.data());
+	for (size_t i = 0; i < n; i++) {
+		ASSERT_TRUE((bitmap[i/8] >> (i%8)) & 1U);
+	}
+
+	std::vector<uint8_t> space(pbf_data_size(bf));
+	auto view = pbf_wrap(way, page_level, page_num, seed, space.data(), 0);
+	ASSERT_NE(nullptr, view);
+	EXPECT_EQ(pbf_data(view), space.data());
+	EXPECT_TRUE(pbf_set(view, nullptr, 0));
+	EXPECT_FALSE(pbf_set(view, nullptr, 0));
+	EXPECT_TRUE(pbf_test(view, nullptr, 0));
+	EXPECT_FALSE(pbf_set(view, nullptr, 1));
+	EXPECT_FALSE(pbf_test(view, nullptr, 1));
+	if (seed == 0) {
+		EXPECT_TRUE(CApiTest(way, space.data(), page_level, page_num, nullptr, 0));
+		uint64_t key = 42;
+		EXPECT_TRUE(pbf_set(view, &key, 8));
+		EXPECT_TRUE(CApiTest(way, space.data(), page_level, page_num, &key, 8));
+	}
+	EXPECT_EQ(pbf_unique_cnt(view), seed == 0 ? 2U : 1U);
+	pbf_free(view);
+
+	pbf_clear(bf);
+	EXPECT_EQ(pbf_unique_cnt(bf), 0U);
+	EXPECT_FALSE(pbf_test(bf, strip, 8));
+	pbf_free(bf);
+}
+
+TEST(PBF, CApiHandle) {
+	CheckHandle(4, 6, 1, 0);
+	CheckHandle(5, 7, 37, 0);
+	CheckHandle(6, 9, 977, 0x5eedULL);
+	CheckHandle(7, 12, 3, 0);
+	CheckHandle(8, 13, 64, 7);
+
+	EXPECT_EQ(nullptr, pbf_create(3, 8, 1, 0));
+	EXPECT_EQ(nullptr, pbf_create(8, 6, 1, 0));
+	EXPECT_EQ(nullptr, pbf_create(8, 14, 1, 0));
+	EXPECT_EQ(nullptr, pbf_create(8, 12, 0, 0));
+	EXPECT_EQ(nullptr, pbf_create(8, 12, pbf::kMaxPageNum, 0));
+	EXPECT_EQ(nullptr, pbf_restore(8, 12, 1, 0, nullptr, 0));
+	EXPECT_EQ(nullptr, pbf_wrap(8, 12, 1, 0, nullptr, 0));
+	pbf_free(nullptr);
+	EXPECT_EQ(pbf_way(nullptr), 0U);
+	EXPECT_EQ(pbf_page_num(nullptr), 0U);
+	EXPECT_EQ(pbf_unique_cnt(nullptr), 0U);
+	EXPECT_EQ(pbf_data(nullptr), nullptr);
+	EXPECT_EQ(pbf_data_size(nullptr), 0U);
+	pbf_clear(nullptr);
+	EXPECT_FALSE(pbf_fold(nullptr, 1));
+	uint64_t none = 1;
+	uint8_t untouched = 0xa5;
+	EXPECT_FALSE(pbf_set(nullptr, &none, 8));
+	EXPECT_FALSE(pbf_test(nullptr, &none, 8));
+	pbf_test_strided(nullptr, &none, 8, 1, &untouched);
+	EXPECT_EQ(untouched, 0xa5);
+
+	// Stateless batch calls agree with the per-key calls and the handle.
+	std::vector<uint8_t> space(size_t{37} << 7U);
+	std::vector<uint64_t> keys(100);
+	std::vector<size_t> offsets(keys.size() + 1);
+	for (size_t i = 0; i < keys.size(); i++) {
+		keys[i] = i * 0x9e3779b97f4a7c15ULL;
+		offsets[i+1] = offsets[i] + 8;
+	}
+	EXPECT_EQ(PBF5_SetStrided(space.data(), 7, 37, keys.data(), 8, 50, nullptr), 50U);
+	std::vector<uint8_t> strided(13), offset(13);
+	PBF5_TestStrided(space.data(), 7, 37, keys.data(), 8, keys.size(), strided.data());
+	PBF5_TestOffsets(space.data(), 7, 37, keys.data(), offsets.data(), keys.size(), offset.data());
+	EXPECT_EQ(strided, offset);
+	for (size_t i = 0; i < keys.size(); i++) {
+		ASSERT_EQ(PBF5_Test(space.data(), 7, 37, &keys[i], 8), ((strided[i/8] >> (i%8)) & 1U) != 0);
+	}
+	auto view = pbf_wrap(5, 7, 37, 0, space.data(), 50);
+	pbf_test_strided(view, keys.data(), 8, keys.size(), offset.data());
+	EXPECT_EQ(strided, offset);
+	pbf_free(view);
+	EXPECT_EQ(PBF5_SetOffsets(space.data(), 7, 37, keys.data(), offsets.data(), 50, nullptr), 0U);
+}
+
 TEST(PBF, RestoreRejectsInvalidBitmapSize) {
 	std::vector<uint8_t> data(129);
 	EXPECT_EQ(nullptr, pbf::New(7, 7, data.data(), data.size(), 0));
@@ -239,3 +397,978 @@ TEST(PBF, Copy) {
 		ASSERT_FALSE(bf->test(reinterpret_cast<const uint8_t*>(&i), 8));
 	}
 }
+
+TEST(PBF, Fold) {
+	pbf::PageBloomFilter<6> big(8, 60);
+	pbf::PageBloomFilter<6> small(8, 15);
+	std::vector<uint8_t> space(60 << 8U);
+	for (uint64_t i = 0; i < 3000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		big.set(key, 8);
+		small.set(key, 8);
+		PBF6_Set(space.data(), 8, 60, key, 8);
+	}
+	for (unsigned factor : {0U, 7U, 8U, 61U}) {
+		EXPECT_FALSE(big.foldable(factor));
+		EXPECT_FALSE(big.fold(factor));
+		EXPECT_FALSE(PBF_Fold(space.data(), 8, 60, factor));
+	}
+	EXPECT_EQ(big.page_num(), 60U);
+	auto unique_cnt = big.unique_cnt();
+	ASSERT_TRUE(big.foldable(4));
+	ASSERT_TRUE(big.fold(4));
+	ASSERT_EQ(big.page_num(), 15U);
+	ASSERT_EQ(big.data_size(), small.data_size());
+	EXPECT_EQ(0, memcmp(big.data(), small.data(), small.data_size()));
+	EXPECT_EQ(big.unique_cnt(), unique_cnt);
+	for (uint64_t i = 0; i < 3000; i++) {
+		ASSERT_TRUE(big.test(reinterpret_cast<const uint8_t*>(&i), 8));
+	}
+	EXPECT_TRUE(big.fold(1));
+	EXPECT_TRUE(big.fold(15));
+	EXPECT_EQ(big.page_num(), 1U);
+
+	ASSERT_TRUE(PBF_Fold(space.data(), 8, 60, 4));
+	EXPECT_EQ(0, memcmp(space.data(), small.data(), small.data_size()));
+
+	auto bf = pbf_create(6, 8, 60, 0);
+	ASSERT_NE(bf, nullptr);
+	for (uint64_t i = 0; i < 3000; i++) {
+		pbf_set(bf, &i, 8);
+	}
+	EXPECT_FALSE(pbf_fold(bf, 9));
+	ASSERT_TRUE(pbf_fold(bf, 4));
+	EXPECT_EQ(pbf_page_num(bf), 15U);
+	ASSERT_EQ(pbf_data_size(bf), small.data_size());
+	EXPECT_EQ(0, memcmp(pbf_data(bf), small.data(), small.data_size()));
+	for (uint64_t i = 0; i < 3000; i++) {
+		ASSERT_TRUE(pbf_test(bf, &i, 8));
+	}
+	pbf_free(bf);
+
+	pbf::PageBloomFilter<6> empty(0, 0);
+	EXPECT_FALSE(empty.foldable(1));
+	EXPECT_FALSE(empty.fold(1));
+}
+
+struct CountingResource : public pbf::MemoryResource {
+	size_t live = 0;
+	size_t calls = 0;
+	bool fail = false;
+	void* allocate(size_t size, size_t align) noexcept override {
+		if (fail) return nullptr;
+		calls++;
+		live += size;
+		return pbf::DefaultMemoryResource()->allocate(size, align);
+	}
+	void deallocate(void* p, size_t size, size_t align) noexcept override {
+		live -= size;
+		pbf::DefaultMemoryResource()->deallocate(p, size, align);
+	}
+};
+
+TEST(PBF, MemoryResource) {
+	CountingResource counting;
+	{
+		pbf::PageBloomFilter<8> bf(12, 5, 0, nullptr, pbf::DefaultHash(), 0, &counting);
+		ASSERT_FALSE(!bf);
+		EXPECT_EQ(counting.live, bf.data_size());
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(bf.data()) % 64, 0U);
+		for (uint64_t i = 0; i < 100; i++) {
+			bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+		}
+		ASSERT_TRUE(bf.fold(5));
+		EXPECT_EQ(counting.live, bf.data_size());
+		EXPECT_EQ(counting.calls, 2U);
+		auto boxed = pbf::New(8, 12, bf.data(), bf.data_size(), bf.unique_cnt(), pbf::DefaultHash(), 0, &counting);
+		ASSERT_NE(boxed, nullptr);
+		EXPECT_EQ(counting.live, bf.data_size() * 2);
+		for (uint64_t i = 0; i < 100; i++) {
+			ASSERT_TRUE(boxed->test(reinterpret_cast<const uint8_t*>(&i), 8));
+		}
+	}
+	EXPECT_EQ(counting.live, 0U);
+	counting.fail = true;
+	pbf::PageBloomFilter<8> none(12, 5, 0, nullptr, pbf::DefaultHash(), 0, &counting);
+	EXPECT_TRUE(!none);
+	EXPECT_EQ(pbf::New(1000, 0.01, pbf::DefaultHash(), 0, &counting), nullptr);
+
+	counting.fail = false;
+	{
+		counting.calls = 0;
+		pbf::PoolMemoryResource pool(1000, 4, &counting);
+		EXPECT_EQ(pool.block_size(), 1024U);
+		std::vector<pbf::PageBloomFilter<6>> filters;
+		const uint8_t* first = nullptr;
+		for (unsigned i = 0; i < 6; i++) {
+			filters.emplace_back(8, 4, 0, nullptr, pbf::DefaultHash(), 0, &pool);
+			ASSERT_FALSE(!filters.back());
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(filters.back().data()) % 64, 0U);
+			if (i == 0) first = filters.back().data();
+		}
+		EXPECT_EQ(counting.calls, 2U);
+		filters.erase(filters.begin());
+		filters.emplace_back(8, 4, 0, nullptr, pbf::DefaultHash(), 0, &pool);
+		EXPECT_EQ(filters.back().data(), first);
+		EXPECT_EQ(counting.calls, 2U);
+		filters.emplace_back(9, 4, 0, nullptr, pbf::DefaultHash(), 0, &pool);	// larger than a block
+		EXPECT_EQ(counting.calls, 3U);
+	}
+	EXPECT_EQ(counting.live, 0U);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#if defined(__linux__)
+static size_t ResidentPages(const uint8_t* data, size_t size) {
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	std::vector<unsigned char> vec((size + page - 1) / page);
+	if (mincore(const_cast<uint8_t*>(data), size, vec.data()) != 0) {
+		return SIZE_MAX;
+	}
+	return static_cast<size_t>(std::count_if(vec.begin(), vec.end(), [](unsigned char v) { return v & 1; }));
+}
+#endif
+
+TEST(PBF, MappedMemoryResource) {
+	pbf::MappedMemoryResource mapped(64 << 10);
+	EXPECT_TRUE(mapped.zeroed());
+	pbf::PageBloomFilter<8> bf(12, 1000, 0, nullptr, pbf::DefaultHash(), 0, &mapped);
+	ASSERT_FALSE(!bf);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(bf.data()) % 4096, 0U);
+#if defined(__linux__)
+	EXPECT_EQ(ResidentPages(bf.data(), bf.data_size()), 0U);
+#endif
+	for (uint64_t i = 0; i < 20000; i++) {
+		bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	const auto data = bf.data();
+	const auto fresh = bf.unique_cnt();
+	bf.clear();
+	EXPECT_EQ(bf.data(), data);
+	EXPECT_EQ(bf.unique_cnt(), 0U);
+#if defined(__linux__)
+	EXPECT_EQ(ResidentPages(bf.data(), bf.data_size()), 0U);
+#endif
+	EXPECT_TRUE(std::all_of(bf.data(), bf.data() + bf.data_size(), [](uint8_t b) { return b == 0; }));
+	for (uint64_t i = 0; i < 20000; i++) {
+		bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	EXPECT_EQ(bf.unique_cnt(), fresh);
+
+	// Ranges below the threshold fall back to memset.
+	pbf::PageBloomFilter<8> small(12, 4, 0, nullptr, pbf::DefaultHash(), 0, &mapped);
+	ASSERT_FALSE(!small);
+	uint64_t key = 1;
+	small.set(reinterpret_cast<const uint8_t*>(&key), 8);
+	EXPECT_FALSE(mapped.discard(const_cast<uint8_t*>(small.data()), small.data_size()));
+	small.clear();
+	EXPECT_FALSE(small.test(reinterpret_cast<const uint8_t*>(&key), 8));
+
+	// Filters in an array start off page boundaries, so discard zeroes the edges in place.
+	pbf::BloomFilterArray array(4, 8, 9, 300, pbf::DefaultHash(), 0, &mapped);
+	ASSERT_FALSE(!array);
+	for (size_t id = 0; id < array.size(); id++) {
+		for (uint64_t i = 0; i < 3000; i++) {
+			array.set(id, reinterpret_cast<const uint8_t*>(&i), 8);
+		}
+	}
+	array.clear(1);
+	for (size_t id = 0; id < array.size(); id++) {
+		size_t hit = 0;
+		for (uint64_t i = 0; i < 3000; i++) {
+			hit += array.test(id, reinterpret_cast<const uint8_t*>(&i), 8);
+		}
+		EXPECT_EQ(hit, id == 1 ? 0U : 3000U);
+	}
+}
+#endif
+
+TEST(PBF, Visit) {
+	for (unsigned way = 4; way <= 8; way++) {
+		auto bf = pbf::New(way, 10, 3);
+		ASSERT_NE(bf, nullptr);
+		auto fresh = bf->visit([](auto& filter) {
+			size_t cnt = 0;
+			for (uint64_t i = 0; i < 500; i++) {
+				cnt += filter.set(reinterpret_cast<const uint8_t*>(&i), 8);
+			}
+			return cnt;
+		});
+		EXPECT_EQ(bf->unique_cnt(), fresh);
+		const pbf::BloomFilter& ref = *bf;
+		EXPECT_EQ(ref.visit([](const auto& filter) { return filter.way(); }), way);
+		ref.visit([&ref](const auto& filter) {
+			EXPECT_EQ(filter.data(), ref.data());
+			for (uint64_t i = 0; i < 1000; i++) {
+				auto key = reinterpret_cast<const uint8_t*>(&i);
+				ASSERT_EQ(filter.test(key, 8), ref.test(key, 8));
+			}
+		});
+	}
+}
+
+TEST(PBF, Batch) {
+	auto bf = pbf::New(7, 9, 5);
+	auto ref = pbf::New(7, 9, 5);
+	ASSERT_NE(nullptr, bf);
+	ASSERT_NE(nullptr, ref);
+
+	std::vector<uint64_t> nums(1000);
+	for (size_t i = 0; i < nums.size(); i++) {
+		nums[i] = i % 700;	// duplicates inside and across windows
+	}
+	std::vector<const uint8_t*> keys;
+	std::vector<unsigned> lens;
+	size_t fresh = 0;
+	for (auto& num : nums) {
+		keys.push_back(reinterpret_cast<const uint8_t*>(&num));
+		lens.push_back(8);
+		fresh += ref->set(keys.back(), 8);
+	}
+	keys.push_back(nullptr);
+	lens.push_back(0);
+	fresh += ref->set(nullptr, 0);
+	keys.push_back(nullptr);
+	lens.push_back(1);
+
+	EXPECT_EQ(fresh, bf->set_batch(keys.data(), lens.data(), keys.size()));
+	EXPECT_EQ(ref->unique_cnt(), bf->unique_cnt());
+	EXPECT_TRUE(std::equal(ref->data(), ref->data() + ref->data_size(), bf->data()));
+
+	std::vector<uint64_t> probes(1500);
+	for (size_t i = 0; i < probes.size(); i++) {
+		probes[i] = i;
+	}
+	std::unique_ptr<bool[]> out(new bool[probes.size()]);
+	bf->test_batch(reinterpret_cast<const uint8_t*>(probes.data()), 8, probes.size(), out.get());
+	for (size_t i = 0; i < probes.size(); i++) {
+		ASSERT_EQ(ref->test(reinterpret_cast<const uint8_t*>(&probes[i]), 8), out[i]);
+	}
+	out.reset(new bool[keys.size()]);
+	bf->test_batch(keys.data(), lens.data(), keys.size(), out.get());
+	for (size_t i = 0; i + 1 < keys.size(); i++) {
+		ASSERT_TRUE(out[i]);
+	}
+	EXPECT_FALSE(out[keys.size()-1]);
+
+	pbf::PageBloomFilter<5> direct(8, 3);
+	pbf::PageBloomFilter<5> single(8, 3);
+	for (auto& num : nums) {
+		single.set(reinterpret_cast<const uint8_t*>(&num), 8);
+	}
+	EXPECT_EQ(single.unique_cnt(),
+			  direct.set_batch(reinterpret_cast<const uint8_t*>(nums.data()), 8, nums.size()));
+	EXPECT_TRUE(std::equal(single.data(), single.data() + single.data_size(), direct.data()));
+}
+
+TEST(PBF, Stats) {
+	auto bf = pbf::New(20000, 0.01);
+	ASSERT_NE(nullptr, bf);
+	auto empty = bf->stats(0.01f);
+	EXPECT_EQ(bf->page_num(), empty.pages);
+	EXPECT_EQ(0, empty.fill_ratio);
+	EXPECT_EQ(0, empty.estimated_items);
+	EXPECT_EQ(bf->page_num(), empty.histogram[0]);
+	EXPECT_NEAR(static_cast<double>(bf->virtual_capacity(0.01f)), static_cast<double>(empty.capacity_remaining),
+				bf->virtual_capacity(0.01f) * 0.001);
+
+	for (uint64_t i = 0; i < 20000; i++) {
+		bf->set(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	auto full = bf->stats(0.01f);
+	size_t bits = 0;
+	for (size_t i = 0; i < bf->data_size(); i++) {
+		for (unsigned j = 0; j < 8; j++) {
+			bits += (bf->data()[i] >> j) & 1U;
+		}
+	}
+	EXPECT_DOUBLE_EQ(static_cast<double>(bits) / (bf->data_size() * 8), full.fill_ratio);
+	EXPECT_LE(full.min_page_fill, full.fill_ratio);
+	EXPECT_GE(full.max_page_fill, full.fill_ratio);
+	EXPECT_NEAR(20000.0, static_cast<double>(full.estimated_items), 600.0);
+	EXPECT_GT(full.estimated_fpr, 0.002);
+	EXPECT_LT(full.estimated_fpr, 0.02);
+	EXPECT_LT(full.capacity_remaining, empty.capacity_remaining);
+	size_t pages = 0;
+	for (auto n : full.histogram) {
+		pages += n;
+	}
+	EXPECT_EQ(full.pages, pages);
+
+	auto sampled = bf->stats(0.01f, 4);
+	EXPECT_EQ((bf->page_num() + 3) / 4, sampled.pages);
+	EXPECT_NEAR(full.fill_ratio, sampled.fill_ratio, 0.05);
+	EXPECT_NEAR(static_cast<double>(full.estimated_items), static_cast<double>(sampled.estimated_items), 2000.0);
+
+	// Same set bits, spread evenly or piled into half the pages: the uneven
+	// bitmap has the higher FPR and reaches the target sooner.
+	constexpr unsigned kLevel = 10, kPages = 64;
+	std::vector<uint8_t> even(kPages << kLevel), skewed(kPages << kLevel);
+	for (unsigned p = 0; p < kPages; p++) {
+		memset(even.data() + (p << kLevel), 0xff, 128);
+		if (p % 2 == 0) {
+			memset(skewed.data() + (p << kLevel), 0xff, 256);
+		}
+	}
+	auto a = pbf::New(8, kLevel, even.data(), even.size(), 0);
+	auto b = pbf::New(8, kLevel, skewed.data(), skewed.size(), 0);
+	ASSERT_NE(a, nullptr);
+	ASSERT_NE(b, nullptr);
+	auto sa = a->stats(0.01f);
+	auto sb = b->stats(0.01f);
+	EXPECT_DOUBLE_EQ(sa.fill_ratio, sb.fill_ratio);
+	EXPECT_GT(sb.estimated_fpr, sa.estimated_fpr);
+	EXPECT_LT(sb.capacity_remaining, sa.capacity_remaining);
+	EXPECT_GT(sb.capacity_remaining, 0U);
+	EXPECT_EQ(b->stats(1e-9f).capacity_remaining, 0U);
+}
+
+TEST(PBF, OpStats) {
+	auto before = pbf::SnapshotOpStats();
+	pbf::PageBloomFilter<6> bf(8, 64);
+	size_t fresh = 0;
+	for (uint64_t i = 0; i < 1000; i++) {
+		fresh += bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+		bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	size_t hits = 0;
+	for (uint64_t i = 0; i < 2000; i++) {
+		hits += bf.test(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	std::vector<uint64_t> keys(300);
+	for (uint64_t i = 0; i < keys.size(); i++) {
+		keys[i] = i + 1000;
+	}
+	std::unique_ptr<bool[]> out(new bool[keys.size()]);
+	bf.test_batch(reinterpret_cast<const uint8_t*>(keys.data()), 8, keys.size(), out.get());
+	for (size_t i = 0; i < keys.size(); i++) {
+		hits += out[i];
+	}
+	fresh += bf.set_batch(reinterpret_cast<const uint8_t*>(keys.data()), 8, keys.size());
+	std::thread worker([&bf]() {
+		for (uint64_t i = 0; i < 1000; i++) {
+			bf.test(reinterpret_cast<const uint8_t*>(&i), 8);
+		}
+	});
+	worker.join();
+	auto after = pbf::SnapshotOpStats();
+
+	if (!pbf::OpStatsEnabled()) {
+		EXPECT_EQ(after.tests, 0U);
+		EXPECT_EQ(after.sets, 0U);
+		EXPECT_EQ(after.sample_period, 0U);
+		return;
+	}
+	EXPECT_EQ(after.tests - before.tests, 2000U + 300U + 1000U);
+	EXPECT_EQ(after.positives - before.positives, hits + 1000U);
+	EXPECT_EQ(after.sets - before.sets, 2000U + 300U);
+	EXPECT_EQ(after.new_inserts - before.new_inserts, fresh);
+	EXPECT_EQ(after.batches - before.batches, 2U);
+	EXPECT_EQ(after.batch_sizes[8] - before.batch_sizes[8], 2U);
+	ASSERT_GT(after.sample_period, 0U);
+	EXPECT_GT(after.ticks_per_ns, 0.0);
+	uint64_t samples = 0;
+	for (unsigned i = 0; i < pbf::OpStats::kBins; i++) {
+		samples += after.test_latency[i] - before.test_latency[i];
+		samples += after.set_latency[i] - before.set_latency[i];
+	}
+	EXPECT_GE(samples, 5000U / after.sample_period - 2);
+}
+
+TEST(PBF, Plan) {
+	pbf::PlanRequest req;
+	EXPECT_FALSE(pbf::PlanFilter(req));
+	req.item = 500;
+	EXPECT_FALSE(pbf::PlanFilter(req));	// neither target nor budget
+
+	req.fpr = 0.01f;
+	auto plan = pbf::PlanFilter(req);
+	ASSERT_TRUE(!!plan);
+	EXPECT_LE(plan.fpr, 0.01);
+	EXPECT_LE(plan.data_size(), pbf::New(500, 0.01)->data_size() * 11 / 10);
+	auto bf = pbf::New(plan);
+	ASSERT_NE(nullptr, bf);
+	EXPECT_EQ(plan.way, bf->way());
+	EXPECT_EQ(plan.page_level, bf->page_level());
+	EXPECT_EQ(plan.page_num, bf->page_num());
+
+	req.item = 1000000;
+	req.fpr = 0.001f;
+	req.memory_budget = 1 << 20;	// too small for the target
+	plan = pbf::PlanFilter(req);
+	ASSERT_TRUE(!!plan);
+	EXPECT_LE(plan.data_size(), req.memory_budget);
+	EXPECT_GT(plan.fpr, 0.001);
+	req.fpr = 0;
+	auto lowest = pbf::PlanFilter(req);
+	EXPECT_NEAR(plan.fpr, lowest.fpr, lowest.fpr * 0.02);
+
+	req.memory_budget = 0;
+	req.fpr = 0.01f;
+	auto dram = pbf::PlanFilter(req);
+	req.tier = pbf::CacheTier::kL2;
+	plan = pbf::PlanFilter(req);
+	EXPECT_LE(plan.data_size(), req.l2_size);
+	EXPECT_LT(plan.probe_cost, dram.probe_cost);
+	EXPECT_GT(plan.fpr, dram.fpr);
+
+	pbf::PageBloomFilter<8> direct(dram);
+	EXPECT_EQ(dram.way == 8, !!direct);
+}
+
+TEST(PBF, HashBackends) {
+	EXPECT_TRUE(pbf::HashAvailable(pbf::HashId::kSpooky));
+	EXPECT_TRUE(pbf::HashAvailable(pbf::HashId::kCRC32C));
+	EXPECT_TRUE(pbf::HashAvailable(pbf::DefaultHash()));
+	const auto bogus = static_cast<pbf::HashId>(9);
+	EXPECT_FALSE(pbf::HashAvailable(bogus));
+	EXPECT_EQ(nullptr, pbf::New(1000, 0.01, bogus));
+	EXPECT_EQ(pbf::DefaultHash(), pbf::New(1000, 0.01)->hash_id());
+
+	const pbf::HashId ids[] = {
+		pbf::HashId::kSpooky, pbf::HashId::kXXH3, pbf::HashId::kAESNI, pbf::HashId::kCRC32C,
+	};
+	for (auto id : ids) {
+		if (!pbf::HashAvailable(id)) {
+			continue;
+		}
+		SCOPED_TRACE(pbf::HashName(id));
+		auto bf = pbf::New(1000, 0.01, id);
+		ASSERT_NE(nullptr, bf);
+		EXPECT_EQ(id, bf->hash_id());
+		for (uint64_t i = 0; i < 1000; i++) {
+			bf->set(reinterpret_cast<const uint8_t*>(&i), 8);
+		}
+		auto copy = pbf::New(bf->way(), bf->page_level(), bf->page_num(), bf->unique_cnt(), bf->data(), id);
+		ASSERT_NE(nullptr, copy);
+		size_t hit = 0;
+		for (uint64_t i = 0; i < 1000; i++) {
+			ASSERT_TRUE(copy->test(reinterpret_cast<const uint8_t*>(&i), 8));
+		}
+		for (uint64_t i = 1000; i < 11000; i++) {
+			hit += copy->test(reinterpret_cast<const uint8_t*>(&i), 8);
+		}
+		EXPECT_LT(hit, 300U);
+	}
+
+	// CRC32C output must not depend on whether the CPU has the instruction.
+	auto bf = pbf::New(1, 0.01, pbf::HashId::kCRC32C);
+	ASSERT_NE(nullptr, bf);
+	for (unsigned len = 0; len <= 40; len++) {
+		std::vector<uint8_t> key(len + 1);
+		for (unsigned i = 0; i < len; i++) {
+			key[i] = static_cast<uint8_t>(i * 7 + len);
+		}
+		bf->set(key.data(), len);
+	}
+	const auto expected = FromHex(
+		"1006310134429000aa2400c04208500a10a000102040480282c1801470891345"
+		"b0022010080500090811c290860865018414000840388c053007aa8090b00600"
+		"793860230160a00208824820250c105002162852f0510c82080110400808e4d9"
+		"0602d680055001000408220a260081129c404208019802112818a1a7400a210e");
+	ASSERT_EQ(expected.size(), bf->data_size());
+	EXPECT_TRUE(std::equal(expected.begin(), expected.end(), bf->data()));
+}
+
+TEST(PBF, Seed) {
+	const pbf::HashId ids[] = {
+		pbf::HashId::kSpooky, pbf::HashId::kXXH3, pbf::HashId::kAESNI, pbf::HashId::kCRC32C,
+	};
+	for (auto id : ids) {
+		if (!pbf::HashAvailable(id)) {
+			continue;
+		}
+		SCOPED_TRACE(pbf::HashName(id));
+		auto plain = pbf::New(1000, 0.01, id);
+		auto zero = pbf::New(1000, 0.01, id, 0);
+		auto a = pbf::New(1000, 0.01, id, 1);
+		auto b = pbf::New(1000, 0.01, id, 0x123456789abcdef0ULL);
+		ASSERT_NE(nullptr, a);
+		ASSERT_NE(nullptr, b);
+		EXPECT_EQ(0x123456789abcdef0ULL, b->seed());
+		for (uint64_t i = 0; i < 1000; i++) {
+			auto key = reinterpret_cast<const uint8_t*>(&i);
+			plain->set(key, 8);
+			zero->set(key, 8);
+			a->set(key, 8);
+			b->set(key, 8);
+		}
+		EXPECT_TRUE(std::equal(plain->data(), plain->data() + plain->data_size(), zero->data()));
+		EXPECT_FALSE(std::equal(a->data(), a->data() + a->data_size(), b->data()));
+
+		// Independent families: a stranger passes both filters at about fpr^2.
+		size_t hit_a = 0, hit_both = 0;
+		auto copy = pbf::New(b->way(), b->page_level(), b->page_num(), b->unique_cnt(), b->data(), id, b->seed());
+		for (uint64_t i = 0; i < 1000; i++) {
+			ASSERT_TRUE(copy->test(reinterpret_cast<const uint8_t*>(&i), 8));
+		}
+		for (uint64_t i = 1000; i < 41000; i++) {
+			auto key = reinterpret_cast<const uint8_t*>(&i);
+			bool in_a = a->test(key, 8);
+			hit_a += in_a;
+			hit_both += in_a && copy->test(key, 8);
+		}
+		EXPECT_LT(hit_a, 1200U);
+		EXPECT_LT(hit_both, 40U);
+	}
+
+	// The seeded C API agrees with the C++ filter under the default hash.
+	pbf::PageBloomFilter<6> bf(8, 3, 0, nullptr, pbf::DefaultHash(), 42);
+	std::vector<uint8_t> space(bf.data_size());
+	for (uint64_t i = 0; i < 100; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		bf.set(key, 8);
+		PBF6_SetWithSeed(space.data(), 8, 3, key, 8, 42);
+		EXPECT_TRUE(PBF6_TestWithSeed(space.data(), 8, 3, key, 8, 42));
+	}
+	EXPECT_TRUE(std::equal(space.begin(), space.end(), bf.data()));
+	std::fill(space.begin(), space.end(), 0);
+	uint64_t key = 7;
+	PBF6_SetWithSeed(space.data(), 8, 3, &key, 8, 0);
+	EXPECT_TRUE(PBF6_Test(space.data(), 8, 3, &key, 8));
+}
+
+template <typename Fixed>
+static void CheckFixed(Fixed& fixed, uint64_t seed) {
+	static_assert(Fixed::data_size() == size_t{Fixed::page_num()} << Fixed::page_level(), "");
+	pbf::PageBloomFilter<Fixed::way()> dynamic(Fixed::page_level(), Fixed::page_num(), 0, nullptr,
+											   pbf::DefaultHash(), seed);
+	ASSERT_FALSE(!dynamic);
+	ASSERT_EQ(dynamic.data_size(), fixed.data_size());
+	ASSERT_EQ(dynamic.capacity(), fixed.capacity());
+	for (uint64_t i = 0; i < 500; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		ASSERT_EQ(dynamic.set(key, 8), fixed.set(key, 8));
+	}
+	EXPECT_EQ(dynamic.unique_cnt(), fixed.unique_cnt());
+	EXPECT_TRUE(std::equal(fixed.data(), fixed.data() + fixed.data_size(), dynamic.data()));
+	for (uint64_t i = 0; i < 1000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		ASSERT_EQ(dynamic.test(key, 8), fixed.test(key, 8));
+	}
+	EXPECT_EQ(dynamic.set(nullptr, 0), fixed.set(nullptr, 0));
+	EXPECT_TRUE(fixed.test(nullptr, 0));
+	EXPECT_FALSE(fixed.set(nullptr, 1));
+	EXPECT_FALSE(fixed.test(nullptr, 1));
+
+	Fixed copy(dynamic.data(), dynamic.unique_cnt(), seed);
+	uint64_t key = 123;
+	EXPECT_TRUE(copy.test(reinterpret_cast<const uint8_t*>(&key), 8));
+	copy.clear();
+	EXPECT_FALSE(copy.test(reinterpret_cast<const uint8_t*>(&key), 8));
+}
+
+TEST(PBF, Fixed) {
+	static pbf::FixedPageBloomFilter<6, 8, 37> odd;
+	CheckFixed(odd, 0);
+	static pbf::FixedPageBloomFilter<8, 12, 16> pow2(0x5eedULL);
+	CheckFixed(pow2, 0x5eedULL);
+	static pbf::FixedPageBloomFilter<4, 6, 1> tiny;
+	CheckFixed(tiny, 0);
+}
+
+TEST(PBF, FilterSet) {
+	std::vector<std::unique_ptr<pbf::BloomFilter>> runs;
+	runs.push_back(pbf::New(1000, 0.01));
+	runs.push_back(pbf::New(5, 10, 3));
+	runs.push_back(pbf::New(8, 12, 2, 0, nullptr, pbf::DefaultHash(), 0x5eedULL));
+	runs.push_back(pbf::New(4, 6, 40, 0, nullptr, pbf::HashId::kCRC32C, 7));
+	pbf::PageBloomFilter<7> page(9, 11);
+
+	pbf::FilterSet set;
+	for (auto& bf : runs) {
+		ASSERT_FALSE(!bf);
+		ASSERT_TRUE(set.add(*bf));
+	}
+	ASSERT_TRUE(set.add(page));
+	ASSERT_EQ(set.size(), 5U);
+	for (uint64_t i = 0; i < 1000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		runs[i % 4]->set(key, 8);
+		if (i % 3 == 0) page.set(key, 8);
+	}
+
+	unsigned hits = 0;
+	for (uint64_t i = 0; i < 2000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		uint64_t expect = 0;
+		for (unsigned j = 0; j < runs.size(); j++) {
+			expect |= uint64_t{runs[j]->test(key, 8)} << j;
+		}
+		expect |= uint64_t{page.test(key, 8)} << 4U;
+		auto mask = set.test(key, 8);
+		ASSERT_EQ(expect, mask);
+		ASSERT_EQ(expect != 0, set.test_any(key, 8));
+		hits += i < 1000 && ((mask >> (i % 4)) & 1U) != 0;
+	}
+	EXPECT_EQ(hits, 1000U);
+
+	// fold() replaces the bitmap and the page count, which members captured
+	// on add: take the filter out of the set first, then add it back.
+	set.clear();
+	ASSERT_TRUE(runs[2]->fold(2));
+	for (auto& bf : runs) {
+		ASSERT_TRUE(set.add(*bf));
+	}
+	ASSERT_TRUE(set.add(page));
+	for (uint64_t i = 0; i < 2000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		uint64_t expect = 0;
+		for (unsigned j = 0; j < runs.size(); j++) {
+			expect |= uint64_t{runs[j]->test(key, 8)} << j;
+		}
+		expect |= uint64_t{page.test(key, 8)} << 4U;
+		ASSERT_EQ(expect, set.test(key, 8));
+		if (i < 1000 && i % 4 == 2) {
+			ASSERT_TRUE((expect >> 2U) & 1U);
+		}
+	}
+
+	runs[0]->set(nullptr, 0);
+	EXPECT_EQ(set.test(nullptr, 0) & 1U, 1U);
+	EXPECT_EQ(set.test(nullptr, 1), 0U);
+	EXPECT_FALSE(set.test_any(nullptr, 1));
+
+	pbf::PageBloomFilter<8> empty(0, 0);
+	EXPECT_FALSE(set.add(empty));
+	while (set.size() < pbf::FilterSet::kMaxFilters) {
+		ASSERT_TRUE(set.add(page));
+	}
+	EXPECT_FALSE(set.add(page));
+	uint64_t key = 0;
+	EXPECT_EQ(set.test(reinterpret_cast<const uint8_t*>(&key), 8) >> 4U, ~0ULL >> 4U);
+	set.clear();
+	EXPECT_EQ(set.size(), 0U);
+	EXPECT_EQ(set.test(reinterpret_cast<const uint8_t*>(&key), 8), 0U);
+	EXPECT_FALSE(set.test_any(reinterpret_cast<const uint8_t*>(&key), 8));
+}
+
+TEST(PBF, FilterArray) {
+	constexpr size_t kFilters = 50;
+	pbf::BloomFilterArray array(kFilters, 5, 9, 3, pbf::DefaultHash(), 0x5eedULL);
+	ASSERT_FALSE(!array);
+	EXPECT_EQ(array.size(), kFilters);
+	EXPECT_EQ(array.filter_size(), 3U << 9U);
+	std::vector<pbf::PageBloomFilter<5>> singles;
+	for (size_t i = 0; i < kFilters; i++) {
+		singles.emplace_back(9, 3, 0, nullptr, pbf::DefaultHash(), 0x5eedULL);
+	}
+
+	std::vector<size_t> ids(4000);
+	std::vector<uint64_t> keys(ids.size());
+	for (size_t i = 0; i < ids.size(); i++) {
+		ids[i] = (i * 7) % kFilters;
+		keys[i] = i;
+	}
+	size_t fresh = 0;
+	for (size_t i = 0; i < 2000; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&keys[i]);
+		ASSERT_EQ(array.set(ids[i], key, 8), singles[ids[i]].set(key, 8));
+	}
+	for (size_t i = 2000; i < 3000; i++) {
+		fresh += singles[ids[i]].set(reinterpret_cast<const uint8_t*>(&keys[i]), 8);
+	}
+	EXPECT_EQ(array.set_batch(ids.data() + 2000, reinterpret_cast<const uint8_t*>(keys.data() + 2000), 8, 1000),
+			  fresh);
+	for (size_t i = 0; i < kFilters; i++) {
+		ASSERT_EQ(0, memcmp(array.data(i), singles[i].data(), array.filter_size()));
+	}
+
+	std::vector<const uint8_t*> ptrs(ids.size());
+	std::vector<unsigned> lens(ids.size(), 8);
+	for (size_t i = 0; i < ids.size(); i++) {
+		ptrs[i] = reinterpret_cast<const uint8_t*>(&keys[i]);
+	}
+	std::unique_ptr<bool[]> out(new bool[ids.size()]);
+	array.test_batch(ids.data(), ptrs.data(), lens.data(), ids.size(), out.get());
+	for (size_t i = 0; i < ids.size(); i++) {
+		ASSERT_EQ(out[i], singles[ids[i]].test(ptrs[i], 8));
+		ASSERT_EQ(out[i], array.test(ids[i], ptrs[i], 8));
+		if (i < 3000) {
+			ASSERT_TRUE(out[i]);
+		}
+	}
+
+	EXPECT_FALSE(array.test(kFilters, ptrs[0], 8));
+	EXPECT_FALSE(array.set(kFilters, ptrs[0], 8));
+	EXPECT_EQ(array.data(kFilters), nullptr);
+	EXPECT_FALSE(array.test(0, nullptr, 1));
+
+	auto copy = array.extract(7);
+	ASSERT_NE(copy, nullptr);
+	EXPECT_EQ(copy->way(), 5U);
+	EXPECT_EQ(copy->seed(), 0x5eedULL);
+	EXPECT_EQ(0, memcmp(copy->data(), array.data(7), array.filter_size()));
+	array.clear(7);
+	EXPECT_FALSE(array.test(7, ptrs[1], 8));
+	EXPECT_TRUE(array.test(14, ptrs[2], 8));
+	ASSERT_TRUE(array.load(7, copy->data()));
+	EXPECT_TRUE(array.test(7, ptrs[1], 8));
+	EXPECT_EQ(array.extract(kFilters), nullptr);
+	array.clear();
+	EXPECT_FALSE(array.test(14, ptrs[2], 8));
+
+	EXPECT_TRUE(!pbf::BloomFilterArray(0, 5, 9, 3));
+	EXPECT_TRUE(!pbf::BloomFilterArray(10, 9, 9, 3));
+	EXPECT_TRUE(!pbf::BloomFilterArray(10, 8, 6, 3));
+	EXPECT_TRUE(!pbf::BloomFilterArray(SIZE_MAX / 1000, 8, 12, 3));
+}
+
+template <typename Filter>
+static void CheckFuse(double max_fpr, double max_bits) {
+	constexpr size_t n = 100000;
+	std::vector<uint64_t> keys(n);
+	for (size_t i = 0; i < n; i++) {
+		keys[i] = i * 2;
+	}
+	Filter bf(reinterpret_cast<const uint8_t*>(keys.data()), 8, n, 4, pbf::HashId::kSpooky, 7);
+	ASSERT_FALSE(!bf);
+	EXPECT_EQ(bf.unique_cnt(), n);
+	EXPECT_EQ(bf.seed(), 7U);
+	EXPECT_LE(bf.data_size() * 8.0 / n, max_bits);
+	for (auto key : keys) {
+		ASSERT_TRUE(bf.test(reinterpret_cast<const uint8_t*>(&key), 8));
+	}
+	size_t hits = 0;
+	for (uint64_t i = 1; i < n * 20; i += 2) {
+		hits += bf.test(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	EXPECT_LE(hits / (n * 10.0), max_fpr);
+}
+
+TEST(PBF, BinaryFuse) {
+	CheckFuse<pbf::BinaryFuse8>(0.006, 9.8);
+	CheckFuse<pbf::BinaryFuse16>(0.0001, 19.6);
+
+	// Variable-length keys with duplicates and the empty key.
+	std::vector<std::string> words;
+	for (unsigned i = 0; i < 5000; i++) {
+		words.push_back(std::string(i % 4000 % 37, 'a') + std::to_string(i % 4000));
+	}
+	words.emplace_back();
+	std::vector<const uint8_t*> ptrs;
+	std::vector<unsigned> lens;
+	for (auto& w : words) {
+		ptrs.push_back(reinterpret_cast<const uint8_t*>(w.data()));
+		lens.push_back(static_cast<unsigned>(w.size()));
+	}
+	ptrs.back() = nullptr;
+	pbf::BinaryFuse8 bf(ptrs.data(), lens.data(), ptrs.size(), 0);
+	ASSERT_FALSE(!bf);
+	EXPECT_EQ(bf.unique_cnt(), 4001U);
+	for (auto& w : words) {
+		ASSERT_TRUE(bf.test(reinterpret_cast<const uint8_t*>(w.data()), static_cast<unsigned>(w.size())));
+	}
+	EXPECT_TRUE(bf.test(nullptr, 0));
+	EXPECT_FALSE(bf.test(nullptr, 1));
+
+	lens.back() = 1;
+	EXPECT_TRUE(!pbf::BinaryFuse8(ptrs.data(), lens.data(), ptrs.size()));
+	EXPECT_TRUE(!pbf::BinaryFuse8(ptrs.data(), lens.data(), 1, 1, static_cast<pbf::HashId>(9)));
+	pbf::BinaryFuse16 empty;
+	EXPECT_TRUE(!empty);
+	EXPECT_FALSE(empty.test(nullptr, 0));
+	pbf::BinaryFuse16 one(ptrs.data(), lens.data(), 1);
+	ASSERT_FALSE(!one);
+	EXPECT_TRUE(one.test(ptrs[0], lens[0]));
+}
+
+#ifndef _WIN32
+TEST(PBF, DiskFilter) {
+	pbf::PageBloomFilter<6> bf(8, 37);
+	ASSERT_FALSE(!bf);
+	for (uint64_t i = 0; i < 2000; i += 2) {
+		bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	const uint64_t offset = 100;
+	std::string path = testing::TempDir() + "pbf-disk-test.bin";
+	{
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		std::string header(offset, 'x');
+		out.write(header.data(), header.size());
+		out.write(reinterpret_cast<const char*>(bf.data()), bf.data_size());
+		ASSERT_TRUE(out.good());
+	}
+	EXPECT_EQ(nullptr, pbf::OpenDiskBloomFilter(path.c_str(), 6, 8, 38, offset));
+	EXPECT_EQ(nullptr, pbf::OpenDiskBloomFilter(path.c_str(), 3, 8, 37, offset));
+	pbf::DiskBloomFilter::Options bogus;
+	bogus.hash = static_cast<pbf::HashId>(9);
+	EXPECT_EQ(nullptr, pbf::OpenDiskBloomFilter(path.c_str(), 6, 8, 37, offset, bogus));
+
+	for (int mode = 0; mode < 3; mode++) {
+		pbf::DiskBloomFilter::Options opt;
+		opt.batch_size = 64;
+		opt.queue_depth = 4;
+		opt.use_io_uring = mode != 1;
+		opt.cache_pages = mode == 2 ? 8 : 0;
+		auto disk = pbf::OpenDiskBloomFilter(path.c_str(), 6, 8, 37, offset, opt);
+		ASSERT_NE(nullptr, disk);
+		SCOPED_TRACE(disk->backend());
+		EXPECT_EQ(bf.data_size(), disk->data_size());
+		EXPECT_EQ(bf.hash_id(), disk->hash_id());
+
+		std::vector<std::atomic<int>> got(2000);
+		for (uint64_t i = 0; i < 2000; i++) {
+			got[i] = -1;
+			disk->test(reinterpret_cast<const uint8_t*>(&i), 8, [&got, i](bool hit) {
+				got[i] = hit;
+			});
+		}
+		disk->wait();
+		for (uint64_t i = 0; i < 2000; i++) {
+			ASSERT_EQ(bf.test(reinterpret_cast<const uint8_t*>(&i), 8), got[i] == 1);
+		}
+		uint64_t key = 0;
+		EXPECT_TRUE(disk->test(reinterpret_cast<const uint8_t*>(&key), 8));
+		EXPECT_EQ(0, disk->io_errors());
+	}
+	std::remove(path.c_str());
+}
+
+TEST(PBF, SharedFilter) {
+	EXPECT_EQ(nullptr, pbf::CreateSharedBloomFilter(nullptr, 3, 8, 37));
+	EXPECT_EQ(nullptr, pbf::CreateSharedBloomFilter(nullptr, 6, 8, 0));
+	EXPECT_EQ(nullptr, pbf::CreateSharedBloomFilter(nullptr, 6, 8, 37, static_cast<pbf::HashId>(9)));
+	EXPECT_EQ(nullptr, pbf::AttachSharedBloomFilter(-1));
+
+	auto shm = pbf::CreateSharedBloomFilter(nullptr, 6, 8, 37, pbf::HashId::kSpooky, 42);
+	ASSERT_NE(nullptr, shm);
+	EXPECT_EQ(shm->way(), 6U);
+	EXPECT_EQ(shm->seed(), 42U);
+	EXPECT_TRUE(shm->writable());
+	pbf::PageBloomFilter<6> bf(8, 37, 0, nullptr, pbf::HashId::kSpooky, 42);
+
+	// A forked writer and threads on a second mapping all land in one bitmap.
+	pid_t pid = fork();
+	ASSERT_GE(pid, 0);
+	if (pid == 0) {
+		for (uint64_t i = 0; i < 3000; i += 3) {
+			shm->set(reinterpret_cast<const uint8_t*>(&i), 8);
+		}
+		_exit(0);
+	}
+	auto peer = pbf::AttachSharedBloomFilter(shm->fd());
+	ASSERT_NE(nullptr, peer);
+	std::atomic<size_t> added(0);
+	std::vector<std::thread> writers;
+	for (uint64_t k = 1; k < 3; k++) {
+		writers.emplace_back([&peer, &added, k]() {
+			for (uint64_t i = k; i < 3000; i += 3) {
+				added += peer->set(reinterpret_cast<const uint8_t*>(&i), 8);
+			}
+		});
+	}
+	for (auto& t : writers) {
+		t.join();
+	}
+	int status = 0;
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	for (uint64_t i = 0; i < 3000; i++) {
+		bf.set(reinterpret_cast<const uint8_t*>(&i), 8);
+		ASSERT_TRUE(shm->test(reinterpret_cast<const uint8_t*>(&i), 8));
+	}
+	ASSERT_EQ(bf.data_size(), shm->data_size());
+	EXPECT_EQ(0, memcmp(bf.data(), shm->data(), bf.data_size()));
+	EXPECT_EQ(shm->unique_cnt(), peer->unique_cnt());
+	EXPECT_GE(shm->unique_cnt(), added.load());
+	EXPECT_LE(shm->unique_cnt(), 3000U);
+
+	auto reader = pbf::AttachSharedBloomFilter(shm->fd(), false);
+	ASSERT_NE(nullptr, reader);
+	uint64_t key = 5000;
+	EXPECT_FALSE(reader->set(reinterpret_cast<const uint8_t*>(&key), 8));
+	EXPECT_EQ(reader->test(reinterpret_cast<const uint8_t*>(&key), 8),
+			  bf.test(reinterpret_cast<const uint8_t*>(&key), 8));
+	peer->clear();
+	EXPECT_EQ(reader->unique_cnt(), 0U);
+	key = 0;
+	EXPECT_FALSE(reader->test(reinterpret_cast<const uint8_t*>(&key), 8));
+
+	char name[64];
+	snprintf(name, sizeof(name), "/pbf-test-%ld", static_cast<long>(getpid()));
+	pbf::RemoveSharedBloomFilter(name);
+	auto named = pbf::CreateSharedBloomFilter(name, 4, 6, 5);
+	ASSERT_NE(nullptr, named);
+	EXPECT_EQ(nullptr, pbf::CreateSharedBloomFilter(name, 4, 6, 5));
+	EXPECT_TRUE(named->set(reinterpret_cast<const uint8_t*>(&key), 8));
+	auto other = pbf::AttachSharedBloomFilter(name);
+	ASSERT_NE(nullptr, other);
+	EXPECT_EQ(other->page_num(), 5U);
+	EXPECT_EQ(other->unique_cnt(), 1U);
+	EXPECT_TRUE(other->test(reinterpret_cast<const uint8_t*>(&key), 8));
+	EXPECT_TRUE(pbf::RemoveSharedBloomFilter(name));
+	EXPECT_EQ(nullptr, pbf::AttachSharedBloomFilter(name));
+	EXPECT_TRUE(other->test(reinterpret_cast<const uint8_t*>(&key), 8));
+}
+#endif
+
+TEST(PBF, TwoChoice) {
+	pbf::TwoChoiceBloomFilter<6> bf(8, 300);
+	ASSERT_FALSE(!bf);
+	ASSERT_EQ(bf.data_size(), 300U << 8U);
+	const size_t items = bf.capacity() / 2;
+	for (uint64_t i = 0; i < items; i++) {
+		auto key = reinterpret_cast<const uint8_t*>(&i);
+		bf.set(key, 8);
+		ASSERT_TRUE(bf.test(key, 8));
+		ASSERT_FALSE(bf.set(key, 8));
+	}
+	EXPECT_LE(bf.unique_cnt(), items);
+	EXPECT_GT(bf.unique_cnt(), items * 99 / 100);
+
+	// Counters track set bits, and the two choices narrow the page fill spread
+	// compared with single placement of the same keys.
+	pbf::PageBloomFilter<6> one(8, 300);
+	for (uint64_t i = 0; i < items; i++) {
+		one.set(reinterpret_cast<const uint8_t*>(&i), 8);
+	}
+	auto spread = [](const uint8_t* data, unsigned pages, const pbf::TwoChoiceBloomFilter<6>* check) {
+		unsigned lo = ~0U, hi = 0;
+		for (unsigned p = 0; p < pages; p++) {
+			unsigned bits = 0;
+			for (unsigned j = 0; j < 256; j++) {
+				for (unsigned b = data[p * 256 + j]; b != 0; b &= b - 1) {
+					bits++;
+				}
+			}
+			if (check != nullptr) {
+				EXPECT_EQ(bits, check->page_fill(p));
+			}
+			lo = std::min(lo, bits);
+			hi = std::max(hi, bits);
+		}
+		return hi - lo;
+	};
+	EXPECT_LT(spread(bf.data(), 300, &bf), spread(one.data(), 300, nullptr));
+
+	pbf::TwoChoiceBloomFilter<6> copy(8, 300, bf.unique_cnt(), bf.data());
+	ASSERT_FALSE(!copy);
+	for (unsigned p = 0; p < 300; p++) {
+		ASSERT_EQ(copy.page_fill(p), bf.page_fill(p));
+	}
+	for (uint64_t i = 0; i < items; i++) {
+		ASSERT_TRUE(copy.test(reinterpret_cast<const uint8_t*>(&i), 8));
+	}
+	copy.clear();
+	EXPECT_EQ(copy.page_fill(0), 0U);
+	uint64_t key = 1;
+	EXPECT_FALSE(copy.test(reinterpret_cast<const uint8_t*>(&key), 8));
+
+	EXPECT_TRUE(!pbf::TwoChoiceBloomFilter<8>(6, 10));
+	EXPECT_FALSE(bf.test(nullptr, 1));
+
+	// Fill counters come from the filter's resource along with the bitmap.
+	CountingResource counting;
+	{
+		pbf::TwoChoiceBloomFilter<6> owned(8, 300, 0, nullptr, pbf::DefaultHash(), 0, &counting);
+		ASSERT_FALSE(!owned);
+		EXPECT_EQ(counting.calls, 2U);
+		EXPECT_EQ(counting.live, owned.data_size() + 300 * sizeof(uint16_t));
+		EXPECT_EQ(owned.page_fill(299), 0U);
+	}
+	EXPECT_EQ(counting.live, 0U);
+	counting.fail = true;
+	EXPECT_TRUE(!pbf::TwoChoiceBloomFilter<6>(8, 300, 0, nullptr, pbf::DefaultHash(), 0, &counting));
+}
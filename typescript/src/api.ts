@@ -26,6 +26,30 @@ export type FilterOperation = (
   keyLength: number,
 ) => number;
 
+/**
+ * @internal
+ * Batch entry over keys staged in linear memory: `keyInfo` is the fixed key
+ * width for the strided form or a pointer to `count + 1` u32 offsets. Hit bits
+ * land LSB-first at `bitmap`; set forms return how many keys were new.
+ */
+export type BatchOperation = (
+  space: number,
+  pageLevel: number,
+  pageNum: number,
+  keys: number,
+  keyInfo: number,
+  count: number,
+  bitmap: number,
+) => number | undefined;
+
+/** @internal */
+export interface BatchOperations {
+  readonly setStrided: BatchOperation;
+  readonly testStrided: BatchOperation;
+  readonly setOffsets: BatchOperation;
+  readonly testOffsets: BatchOperation;
+}
+
 /** @internal */
 export interface Allocation {
   pointer: number;
@@ -37,6 +61,8 @@ export interface PageBloomFilterInit {
   readonly memory: WebAssembly.Memory;
   readonly setOperation: FilterOperation;
   readonly testOperation: FilterOperation;
+  /** Absent for WebAssembly builds that predate the batch exports. */
+  readonly batchOperations?: BatchOperations;
   readonly pointer: number;
   readonly length: number;
   readonly allocateScratch: (length: number) => Allocation;
@@ -48,6 +74,7 @@ export interface PageBloomFilterInit {
 const encoder = new TextEncoder();
 const LN2 = Math.log(2);
 const MAX_PAGE_NUM = 1 << 18;
+const BATCH_SIZE = 1024;
 
 /** @internal */
 export function requireInteger(name: string, value: number, minimum = 0): void {
@@ -160,6 +187,7 @@ export class PageBloomFilter {
   readonly #memory: WebAssembly.Memory;
   readonly #setOperation: FilterOperation;
   readonly #testOperation: FilterOperation;
+  readonly #batch: BatchOperations | undefined;
   readonly #pointer: number;
   readonly #length: number;
   readonly #allocateScratch: (length: number) => Allocation;
@@ -182,6 +210,7 @@ export class PageBloomFilter {
     this.#memory = init.memory;
     this.#setOperation = init.setOperation;
     this.#testOperation = init.testOperation;
+    this.#batch = init.batchOperations;
     this.#pointer = init.pointer;
     this.#length = init.length;
     this.#allocateScratch = init.allocateScratch;
@@ -317,14 +346,160 @@ export class PageBloomFilter {
     ) !== 0;
   }
 
+  // Stages keys[start, start+count) as [bitmap | u32 offsets | key bytes] in
+  // scratch and probes them with one call. Returns a view of the bitmap.
+  #runOffsets(
+    batch: BatchOperations,
+    set: boolean,
+    keys: readonly Key[],
+    start: number,
+    count: number,
+  ): Uint8Array {
+    const bitmapLength = Math.ceil(count / 8);
+    const offsetsStart = Math.ceil(bitmapLength / 4) * 4;
+    const keysStart = offsetsStart + (count + 1) * 4;
+    let bound = 0;
+    for (let i = 0; i < count; i++) {
+      const key = keys[start + i]!;
+      bound += typeof key === "string" ? key.length * 3 : bytes(key).byteLength;
+    }
+    const scratch = this.#prepareScratch(keysStart + bound);
+    const pointer = this.#scratchPointer;
+    const offsets = new Uint32Array(this.#memory.buffer, pointer + offsetsStart, count + 1);
+    let cursor = keysStart;
+    for (let i = 0; i < count; i++) {
+      offsets[i] = cursor - keysStart;
+      const key = keys[start + i]!;
+      if (typeof key === "string") {
+        const { read, written } = encoder.encodeInto(key, scratch.subarray(cursor));
+        if (read !== key.length) throw new RangeError("unable to encode the complete string key");
+        cursor += written;
+      } else {
+        const keyBytes = bytes(key);
+        scratch.set(keyBytes, cursor);
+        cursor += keyBytes.byteLength;
+      }
+    }
+    offsets[count] = cursor - keysStart;
+    const operation = set ? batch.setOffsets : batch.testOffsets;
+    const inserted = operation(
+      this.#pointer,
+      this.pageLevel,
+      this.pageNum,
+      pointer + keysStart,
+      pointer + offsetsStart,
+      count,
+      pointer,
+    );
+    if (set) this.#uniqueCount += inserted ?? 0;
+    return scratch.subarray(0, bitmapLength);
+  }
+
+  // Same for a packed buffer of fixed-width keys: [bitmap | key bytes].
+  #runStrided(
+    batch: BatchOperations,
+    set: boolean,
+    keys: Uint8Array,
+    width: number,
+    start: number,
+    count: number,
+  ): Uint8Array {
+    const bitmapLength = Math.ceil(count / 8);
+    const keysStart = Math.ceil(bitmapLength / 8) * 8;
+    const scratch = this.#prepareScratch(keysStart + count * width);
+    scratch.set(keys.subarray(start * width, (start + count) * width), keysStart);
+    const pointer = this.#scratchPointer;
+    const operation = set ? batch.setStrided : batch.testStrided;
+    const inserted = operation(
+      this.#pointer,
+      this.pageLevel,
+      this.pageNum,
+      pointer + keysStart,
+      width,
+      count,
+      pointer,
+    );
+    if (set) this.#uniqueCount += inserted ?? 0;
+    return scratch.subarray(0, bitmapLength);
+  }
+
   setMany(keys: Iterable<Key>): number {
-    let inserted = 0;
-    for (const key of keys) if (this.set(key)) inserted++;
-    return inserted;
+    this.#assertActive();
+    const batch = this.#batch;
+    if (!batch) {
+      let inserted = 0;
+      for (const key of keys) if (this.set(key)) inserted++;
+      return inserted;
+    }
+    const list = Array.isArray(keys) ? keys as Key[] : Array.from(keys);
+    const before = this.#uniqueCount;
+    for (let start = 0; start < list.length; start += BATCH_SIZE) {
+      this.#runOffsets(batch, true, list, start, Math.min(BATCH_SIZE, list.length - start));
+    }
+    return this.#uniqueCount - before;
   }
 
   testMany(keys: Iterable<Key>): boolean[] {
-    return Array.from(keys, (key) => this.test(key));
+    this.#assertActive();
+    const batch = this.#batch;
+    if (!batch) return Array.from(keys, (key) => this.test(key));
+    const list = Array.isArray(keys) ? keys as Key[] : Array.from(keys);
+    const out = new Array<boolean>(list.length);
+    for (let start = 0; start < list.length; start += BATCH_SIZE) {
+      const count = Math.min(BATCH_SIZE, list.length - start);
+      const bitmap = this.#runOffsets(batch, false, list, start, count);
+      for (let i = 0; i < count; i++) out[start + i] = ((bitmap[i >> 3]! >> (i & 7)) & 1) !== 0;
+    }
+    return out;
+  }
+
+  #packed(keys: ArrayBuffer | ArrayBufferView, width: number): Uint8Array {
+    this.#assertActive();
+    requireInteger("width", width, 1);
+    const buffer = bytes(keys);
+    if (buffer.byteLength % width !== 0) {
+      throw new RangeError("keys length must be a multiple of width");
+    }
+    return buffer;
+  }
+
+  /** Inserts byteLength/width keys of `width` bytes each, packed back to back. */
+  setPacked(keys: ArrayBuffer | ArrayBufferView, width: number): number {
+    const buffer = this.#packed(keys, width);
+    const total = buffer.byteLength / width;
+    const batch = this.#batch;
+    if (!batch) {
+      let inserted = 0;
+      for (let i = 0; i < total; i++) {
+        if (this.set(buffer.subarray(i * width, (i + 1) * width))) inserted++;
+      }
+      return inserted;
+    }
+    const before = this.#uniqueCount;
+    for (let start = 0; start < total; start += BATCH_SIZE) {
+      this.#runStrided(batch, true, buffer, width, start, Math.min(BATCH_SIZE, total - start));
+    }
+    return this.#uniqueCount - before;
+  }
+
+  /** Tests packed fixed-width keys; returns one byte per key, 1 for a hit. */
+  testPacked(keys: ArrayBuffer | ArrayBufferView, width: number): Uint8Array {
+    const buffer = this.#packed(keys, width);
+    const total = buffer.byteLength / width;
+    const out = new Uint8Array(total);
+    const batch = this.#batch;
+    if (!batch) {
+      for (let i = 0; i < total; i++) {
+        out[i] = this.test(buffer.subarray(i * width, (i + 1) * width)) ? 1 : 0;
+      }
+      return out;
+    }
+    for (let start = 0; start < total; start += BATCH_SIZE) {
+      const count = Math.min(BATCH_SIZE, total - start);
+      const bitmap = this.#runStrided(batch, false, buffer, width, start, count);
+      for (let i = 0; i < count; i++) out[start + i] = (bitmap[i >> 3]! >> (i & 7)) & 1;
+    }
+    return out;
   }
 
   capacity(): number {
@@ -5,6 +5,8 @@ import {
   requireInteger,
   validateLayout,
   type Allocation,
+  type BatchOperation,
+  type BatchOperations,
   type FilterOperation,
   type PageBloomFilterInit,
   type WasmSource,
@@ -25,13 +27,23 @@ interface PbfWasmExports extends WebAssembly.Exports {
   PBF8_Test: FilterOperation;
 }
 
+type BatchName = "SetStrided" | "TestStrided" | "SetOffsets" | "TestOffsets";
+
 interface AllocationGroup {
   readonly blocks: Allocation[];
 }
 
+// (func (result v128) i32.const 0 i8x16.splat i8x16.popcnt)
+const SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0,
+  10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
 
 async function defaultWasmBytes(): Promise<Uint8Array<ArrayBuffer>> {
-  const url = new URL("./pagebloomfilter.wasm", import.meta.url);
+  const name = WebAssembly.validate(SIMD_PROBE)
+    ? "./pagebloomfilter-simd.wasm"
+    : "./pagebloomfilter.wasm";
+  const url = new URL(name, import.meta.url);
   if (url.protocol === "file:") {
     const moduleName = "node:fs/promises";
     const { readFile } = await import(moduleName) as typeof import("node:fs/promises");
@@ -127,6 +139,19 @@ class WasmContext {
     return operation as FilterOperation;
   }
 
+  #batchOperations(way: number): BatchOperations | undefined {
+    const lookup = (name: BatchName) => {
+      const operation = (this.#exports as WebAssembly.Exports)[`PBF${way}_${name}`];
+      return typeof operation === "function" ? operation as BatchOperation : undefined;
+    };
+    const setStrided = lookup("SetStrided");
+    const testStrided = lookup("TestStrided");
+    const setOffsets = lookup("SetOffsets");
+    const testOffsets = lookup("TestOffsets");
+    if (!setStrided || !testStrided || !setOffsets || !testOffsets) return undefined;
+    return { setStrided, testStrided, setOffsets, testOffsets };
+  }
+
   create(item: number, fpr: number): PageBloomFilter {
     const [way, pageLevel, pageNum] = createLayout(item, fpr);
     return this.#createFilter(way, pageLevel, pageNum);
@@ -169,6 +194,7 @@ class WasmContext {
       memory: this.memory,
       setOperation: this.#operation(true, way),
       testOperation: this.#operation(false, way),
+      batchOperations: this.#batchOperations(way),
       pointer,
       length,
       allocateScratch: (scratchLength) => {
@@ -140,3 +140,35 @@ test("invalid restored layouts are rejected", async () => {
   await assert.rejects(PageBloomFilter.restore(7, 7, new Uint8Array()), /data length/);
   await assert.rejects(PageBloomFilter.restore(7, 7, new Uint8Array(129)), /data length/);
 });
+
+test("batch calls agree with per-key calls", async () => {
+  const filter = await PageBloomFilter.create(5_000, 0.01);
+  const probe = await PageBloomFilter.create(5_000, 0.01);
+  const many = [];
+  for (let i = 0; i < 3_000; i++) many.push(i % 3 === 0 ? `key-${i}` : new Uint8Array([i, i >> 8, 7]));
+  let expected = 0;
+  for (const key of many.slice(0, 2_000)) if (probe.set(key)) expected++;
+  assert.equal(filter.setMany(many.slice(0, 2_000)), expected);
+  assert.equal(filter.uniqueCount, probe.uniqueCount);
+  assert.deepEqual(filter.data, probe.data);
+  assert.deepEqual(filter.testMany(many), many.map((key) => probe.test(key)));
+  assert.equal(filter.setMany(many.slice(0, 10)), 0);
+  assert.deepEqual(filter.testMany([]), []);
+
+  const packed = new Uint8Array(8 * 2_500);
+  for (let i = 0; i < packed.length; i++) packed[i] = (i * 131) & 0xff;
+  packed.copyWithin(8, 0, 8);
+  expected = 0;
+  for (let i = 0; i < 1_500; i++) if (probe.set(packed.subarray(i * 8, i * 8 + 8))) expected++;
+  assert.equal(filter.setPacked(packed.subarray(0, 8 * 1_500), 8), expected);
+  assert.deepEqual(filter.data, probe.data);
+  const hits = filter.testPacked(packed, 8);
+  assert.equal(hits.length, 2_500);
+  for (let i = 0; i < 2_500; i++) {
+    assert.equal(hits[i], probe.test(packed.subarray(i * 8, i * 8 + 8)) ? 1 : 0);
+  }
+  assert.throws(() => filter.testPacked(packed, 7), /multiple of width/);
+  assert.throws(() => filter.testPacked(packed, 0), /width/);
+  probe.dispose();
+  filter.dispose();
+});